@@ -0,0 +1,344 @@
+//
+//  MJTomlBench.cpp
+//  toml2json-bench
+//
+//  Created by toml2json contributors on 2026/10/18.
+//
+
+// The phases of parse_toml are not public, build them in this translation unit.
+#include "../toml2json/MJToml.cpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+
+#include <sys/resource.h>
+
+// MARK: - Allocation counter
+
+namespace {
+    std::atomic<std::uint64_t> allocation_count(0);
+    std::atomic<std::uint64_t> allocation_bytes(0);
+    std::atomic<std::int64_t> live_bytes(0);
+    std::atomic<std::int64_t> peak_live_bytes(0);
+    
+    // The size is kept in front of the block to track the live bytes
+    std::size_t const HEADER_SIZE = alignof(std::max_align_t);
+    
+    auto counted_malloc(std::size_t size) -> void * {
+        auto ptr = static_cast<char *>(std::malloc(size + HEADER_SIZE));
+        if (ptr == nullptr) {
+            throw std::bad_alloc();
+        }
+        *reinterpret_cast<std::size_t *>(ptr) = size;
+        allocation_count.fetch_add(1, std::memory_order_relaxed);
+        allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+        auto live = live_bytes.fetch_add(static_cast<std::int64_t>(size), std::memory_order_relaxed) + static_cast<std::int64_t>(size);
+        auto peak = peak_live_bytes.load(std::memory_order_relaxed);
+        while (live > peak && !peak_live_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+        }
+        return ptr + HEADER_SIZE;
+    }
+    
+    auto counted_free(void * ptr) -> void {
+        if (ptr == nullptr) {
+            return;
+        }
+        auto block = static_cast<char *>(ptr) - HEADER_SIZE;
+        live_bytes.fetch_sub(static_cast<std::int64_t>(*reinterpret_cast<std::size_t *>(block)), std::memory_order_relaxed);
+        std::free(block);
+    }
+}
+
+void * operator new(std::size_t size) { return counted_malloc(size); }
+void * operator new[](std::size_t size) { return counted_malloc(size); }
+void operator delete(void * ptr) noexcept { counted_free(ptr); }
+void operator delete[](void * ptr) noexcept { counted_free(ptr); }
+void operator delete(void * ptr, std::size_t) noexcept { counted_free(ptr); }
+void operator delete[](void * ptr, std::size_t) noexcept { counted_free(ptr); }
+
+namespace {
+    
+    // MARK: - Generator
+    
+    struct MJTomlBenchShape {
+        char const * name;
+        auto (* generate)(int scale) -> std::string;
+    };
+    
+    // One table with many keys
+    static auto generate_wide(int scale) -> std::string {
+        std::ostringstream ss;
+        ss << "[wide]\n";
+        for (int i = 0; i < scale * 100; ++i) {
+            ss << "key_" << i << " = " << i << "\n";
+        }
+        return ss.str();
+    }
+    
+    // Deep dotted keys
+    static auto generate_deep(int scale) -> std::string {
+        std::ostringstream ss;
+        for (int i = 0; i < scale * 10; ++i) {
+            ss << "[root_" << i;
+            for (int depth = 0; depth < 16; ++depth) {
+                ss << ".level_" << depth;
+            }
+            ss << "]\n";
+            for (int j = 0; j < 8; ++j) {
+                ss << "a." << "b_" << j << ".c = " << j << "\n";
+            }
+        }
+        return ss.str();
+    }
+    
+    // Huge array of tables
+    static auto generate_array_of_tables(int scale) -> std::string {
+        std::ostringstream ss;
+        for (int i = 0; i < scale * 20; ++i) {
+            ss << "[[items]]\n";
+            ss << "id = " << i << "\n";
+            ss << "name = \"item " << i << "\"\n";
+            ss << "price = " << i << ".25\n";
+            ss << "tags = [\"a\", \"b\", \"c\"]\n";
+            ss << "point = { x = " << i << ", y = " << -i << " }\n";
+        }
+        return ss.str();
+    }
+    
+    static auto generate_strings(int scale) -> std::string {
+        std::ostringstream ss;
+        for (int i = 0; i < scale * 20; ++i) {
+            ss << "basic_" << i << " = \"The quick brown fox\\tjumps over the lazy dog \\u00E9 " << i << "\"\n";
+            ss << "literal_" << i << " = 'C:\\Users\\nodejs\\templates\\" << i << "'\n";
+            ss << "multi_line_" << i << " = \"\"\"\nThe quick brown \\\n  fox jumps over\nthe lazy dog " << i << "\"\"\"\n";
+            ss << "multi_line_literal_" << i << " = '''\nThe first newline is\ntrimmed in raw strings " << i << "\n'''\n";
+        }
+        return ss.str();
+    }
+    
+    static auto generate_numbers(int scale) -> std::string {
+        std::ostringstream ss;
+        for (int i = 0; i < scale * 20; ++i) {
+            ss << "int_" << i << " = " << i * 7919 << "\n";
+            ss << "negative_" << i << " = -" << i << "_000\n";
+            ss << "hex_" << i << " = 0x" << std::hex << i * 4099 << std::dec << "\n";
+            ss << "float_" << i << " = " << i << ".5e-3\n";
+            ss << "array_" << i << " = [ " << i << ", " << i + 1 << ", " << i + 2 << " ]\n";
+        }
+        return ss.str();
+    }
+    
+    static auto generate_datetimes(int scale) -> std::string {
+        std::ostringstream ss;
+        for (int i = 0; i < scale * 20; ++i) {
+            auto day = i % 28 + 1;
+            ss << "odt_" << i << " = 1979-05-" << std::setw(2) << std::setfill('0') << day << "T07:32:00.999999-07:00\n";
+            ss << "ldt_" << i << " = 1979-05-" << std::setw(2) << std::setfill('0') << day << "T00:32:00\n";
+            ss << "ld_" << i << " = 1979-05-" << std::setw(2) << std::setfill('0') << day << "\n";
+            ss << "lt_" << i << " = 07:32:" << std::setw(2) << std::setfill('0') << i % 60 << "\n";
+        }
+        return ss.str();
+    }
+    
+    static MJTomlBenchShape const shapes[] = {
+        {"wide", generate_wide},
+        {"deep", generate_deep},
+        {"array_of_tables", generate_array_of_tables},
+        {"strings", generate_strings},
+        {"numbers", generate_numbers},
+        {"datetimes", generate_datetimes},
+    };
+    
+    // MARK: - Measurement
+    
+    struct MJTomlBenchResult {
+        double seconds_min = std::numeric_limits<double>::max();
+        double seconds_total = 0;
+        std::size_t bytes = 0;
+        std::uint64_t allocations = 0;
+        std::uint64_t allocated_bytes = 0;
+        std::int64_t peak_heap_bytes = 0;
+        long peak_rss_kb = 0;
+    };
+    
+    // Resets the peak RSS where it is possible (Linux), returns false if the peak is of the whole process.
+    static auto reset_peak_rss() -> bool {
+        std::ofstream ofs("/proc/self/clear_refs");
+        if (!ofs) {
+            return false;
+        }
+        ofs << "5";
+        return static_cast<bool>(ofs.flush());
+    }
+    
+    static auto peak_rss_kb() -> long {
+        std::ifstream ifs("/proc/self/status");
+        std::string line;
+        while (std::getline(ifs, line)) {
+            if (line.compare(0, 6, "VmHWM:") == 0) {
+                return std::strtol(line.c_str() + 6, nullptr, 10);
+            }
+        }
+        struct rusage usage;
+        ::getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+        return usage.ru_maxrss / 1024;
+#else
+        return usage.ru_maxrss;
+#endif
+    }
+    
+    template <typename F>
+    static auto measure(MJTomlBenchResult * result, F && f) -> void {
+        reset_peak_rss();
+        auto count = allocation_count.load();
+        auto bytes = allocation_bytes.load();
+        peak_live_bytes.store(live_bytes.load());
+        auto base_live_bytes = live_bytes.load();
+        
+        auto begin = std::chrono::steady_clock::now();
+        f();
+        auto end = std::chrono::steady_clock::now();
+        
+        auto seconds = std::chrono::duration<double>(end - begin).count();
+        result->seconds_min = std::min(result->seconds_min, seconds);
+        result->seconds_total += seconds;
+        result->allocations = allocation_count.load() - count;
+        result->allocated_bytes = allocation_bytes.load() - bytes;
+        result->peak_heap_bytes = std::max(result->peak_heap_bytes, peak_live_bytes.load() - base_live_bytes);
+        result->peak_rss_kb = std::max(result->peak_rss_kb, peak_rss_kb());
+    }
+    
+    static auto write_result(std::ostream & os, char const * phase, MJTomlBenchResult const & result, int iterations) -> void {
+        os << "        \"" << phase << "\": {\n";
+        os << "          \"bytes\": " << result.bytes << ",\n";
+        os << "          \"seconds_min\": " << result.seconds_min << ",\n";
+        os << "          \"seconds_mean\": " << result.seconds_total / iterations << ",\n";
+        os << "          \"mb_per_s\": " << result.bytes / 1e6 / result.seconds_min << ",\n";
+        os << "          \"allocations\": " << result.allocations << ",\n";
+        os << "          \"allocated_bytes\": " << result.allocated_bytes << ",\n";
+        os << "          \"peak_heap_bytes\": " << result.peak_heap_bytes << ",\n";
+        os << "          \"peak_rss_kb\": " << result.peak_rss_kb << "\n";
+        os << "        }";
+    }
+    
+    static void usage() {
+        std::cout << "Usage: toml2json-bench [--shape all|wide|deep|array_of_tables|strings|numbers|datetimes] [--scale N] [--iterations N] [--output results.json] [--dump]" << std::endl;
+    }
+}
+
+int main(int argc, const char * argv[]) {
+    std::string shape_name = "all";
+    int scale = 10;
+    int iterations = 5;
+    char const * output_path = nullptr;
+    bool is_dump = false;
+    for (int i = 1; i < argc; ++i) {
+        if (::strcmp(argv[i], "--shape") == 0 && i + 1 < argc) {
+            shape_name = argv[++i];
+        }
+        else if (::strcmp(argv[i], "--scale") == 0 && i + 1 < argc) {
+            scale = std::atoi(argv[++i]);
+        }
+        else if (::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = std::atoi(argv[++i]);
+        }
+        else if (::strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output_path = argv[++i];
+        }
+        else if (::strcmp(argv[i], "--dump") == 0) {
+            is_dump = true;
+        }
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if (scale <= 0 || iterations <= 0) {
+        usage();
+        return 1;
+    }
+    
+    std::ostringstream results;
+    results << std::setprecision(6);
+    results << "{\n";
+    results << "  \"format\": \"toml2json-bench/1\",\n";
+    results << "  \"scale\": " << scale << ",\n";
+    results << "  \"iterations\": " << iterations << ",\n";
+    results << "  \"peak_rss_is_per_phase\": " << (reset_peak_rss() ? "true" : "false") << ",\n";
+    results << "  \"shapes\": {";
+    
+    char const * joiner = "\n";
+    auto is_found = false;
+    for (auto const & shape : shapes) {
+        if (shape_name != "all" && shape_name != shape.name) {
+            continue;
+        }
+        is_found = true;
+        
+        auto str = shape.generate(scale);
+        if (is_dump) {
+            std::cout << str;
+            continue;
+        }
+        
+        MJTomlBenchResult parse_result, convert_result, json_result;
+        for (int i = 0; i < iterations; ++i) {
+            MJToml toml;
+            std::string json;
+            std::string_view view = str;
+            measure(&parse_result, [&] {
+                ::read_table(&toml.table, view.cbegin(), view.cend(), true);
+            });
+            measure(&convert_result, [&] {
+                ::convert_types(&toml.table, nullptr);
+            });
+            measure(&json_result, [&] {
+                json = string_json(toml);
+            });
+            parse_result.bytes = str.size();
+            convert_result.bytes = str.size();
+            json_result.bytes = json.size();
+        }
+        
+        std::cerr << shape.name << ": " << str.size() << " bytes, parse " << parse_result.bytes / 1e6 / parse_result.seconds_min << " MB/s, convert_types " << convert_result.bytes / 1e6 / convert_result.seconds_min << " MB/s, string_json " << json_result.bytes / 1e6 / json_result.seconds_min << " MB/s" << std::endl;
+        
+        results << joiner << "    \"" << shape.name << "\": {\n";
+        results << "      \"input_bytes\": " << str.size() << ",\n";
+        results << "      \"phases\": {\n";
+        write_result(results, "parse_toml", parse_result, iterations);
+        results << ",\n";
+        write_result(results, "convert_types", convert_result, iterations);
+        results << ",\n";
+        write_result(results, "string_json", json_result, iterations);
+        results << "\n      }\n    }";
+        joiner = ",\n";
+    }
+    results << "\n  }\n}\n";
+    
+    if (!is_found) {
+        usage();
+        return 1;
+    }
+    if (is_dump) {
+        return 0;
+    }
+    
+    if (output_path != nullptr) {
+        std::ofstream ofs(output_path);
+        if (ofs.fail()) {
+            std::cerr << "Error: Could not open " << output_path << std::endl;
+            return 2;
+        }
+        ofs << results.str();
+    }
+    else {
+        std::cout << results.str();
+    }
+    return 0;
+}
@@ -15,12 +15,25 @@
 #define MJTOML_LOG(fmt, ...)
 #endif
 
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <climits>
 #include <cmath>
+#include <cstdio>
 #include <cstring>
+#include <deque>
+#include <functional>
 #include <limits>
 #include <sstream>
 #include <regex>
 #include <iomanip>
+#include <thread>
+
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 namespace {
     using namespace MoonJelly;
@@ -30,6 +43,31 @@ namespace {
         std::vector<std::any> values;
     };
     
+    // Adds the elapsed nanoseconds to the counter, does nothing if the counter is nullptr
+    class MJTomlStopwatch {
+    public:
+        explicit MJTomlStopwatch(std::uint64_t * counter) : counter_(counter) {
+            if (counter_ != nullptr) {
+                begin_ = std::chrono::steady_clock::now();
+            }
+        }
+        ~MJTomlStopwatch() {
+            stop();
+        }
+        auto stop() -> void {
+            if (counter_ != nullptr) {
+                *counter_ += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin_).count();
+                counter_ = nullptr;
+            }
+        }
+    private:
+        std::uint64_t * counter_;
+        std::chrono::steady_clock::time_point begin_;
+    };
+    
+    // Set while parse_toml is measuring, the parsing functions are templates shared by all callers
+    static thread_local MJTomlStats * parsing_stats = nullptr;
+    
     template <typename T>
     static auto skip_ws(T itr, T end) -> T;
     template <typename T>
@@ -48,6 +86,8 @@ namespace {
     static auto read_array(std::any * value, T itr, T end) -> T;
     template <typename T>
     static auto read_inline_table(std::any * value, T itr, T end) -> T;
+    template <typename T>
+    static auto read_datetime(MJTomlDateTime * datetime, T itr, T end) -> T;
 
     // MARK: -
     
@@ -144,6 +184,8 @@ namespace {
                 std::vector<std::string> dotted_keys;
                 int type = -1;
                 
+                MJTomlStopwatch lex_stopwatch(parsing_stats != nullptr ? &parsing_stats->lex_ns : nullptr);
+                
                 // Array of table
                 if (type == -1) {
                     // seeAlso: Table
@@ -207,6 +249,8 @@ namespace {
                     }
                 }
                 
+                lex_stopwatch.stop();
+                
                 if (dotted_keys.empty() || type == -1) {
                     throw std::invalid_argument("ill-formed of toml");
                 }
@@ -267,7 +311,10 @@ namespace {
                         }
                         
                         std::any value;
-                        itr = read_value(&value, itr, end);
+                        {
+                            MJTomlStopwatch stopwatch(parsing_stats != nullptr ? &parsing_stats->lex_ns : nullptr);
+                            itr = read_value(&value, itr, end);
+                        }
                         (*child_table)[value_key] = value;
                     }
                     else {
@@ -281,6 +328,181 @@ namespace {
         return itr;
     }
     
+    // The string readers find the closing delimiter and count the characters which grow when escaped in one
+    // forward pass, then write the content into a buffer reserved to that size. The result is JSON-escaped.
+    
+    template <typename T>
+    static auto starts_with(T itr, T end, char const * delimiter) -> bool {
+        for (; *delimiter != '\0'; ++itr, ++delimiter) {
+            if (itr >= end || *itr != *delimiter) {
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    // A newline immediately following the opening delimiter will be trimmed.
+    template <typename T>
+    static auto skip_first_newline(T itr, T end) -> T {
+        if (itr < end && *itr == '\n') {
+            return itr + 1;
+        }
+        if (end - itr >= 2 && itr[0] == '\r' && itr[1] == '\n') {
+            return itr + 2;
+        }
+        return itr;
+    }
+    
+    // Backslashes and quotes are escaped, newlines are written as \r and \n
+    template <typename T>
+    static auto append_literal(std::string * string, T itr, T end) -> void {
+        auto run = itr;
+        for (; itr < end; ++itr) {
+            char const * escaped;
+            switch (*itr) {
+                case '\\': escaped = "\\\\"; break;
+                case '"': escaped = "\\\""; break;
+                case '\r': escaped = "\\r"; break;
+                case '\n': escaped = "\\n"; break;
+                default: continue;
+            }
+            string->append(run, itr);
+            string->append(escaped, 2);
+            run = itr + 1;
+        }
+        string->append(run, end);
+    }
+    
+    template <typename T>
+    static auto read_basic_string(std::string * string, T itr, T end) -> T {
+        auto string_begin = ++itr;
+        while (itr < end && *itr != '"') {
+            if (*itr == '\n' || *itr == '\r') {
+                throw std::invalid_argument("ill-formed of basic strings");
+            }
+            // The escape sequences are kept as they are, JSON shares them
+            if (*itr == '\\') {
+                if (itr + 1 >= end || itr[1] == '\n' || itr[1] == '\r') {
+                    throw std::invalid_argument("ill-formed of basic strings");
+                }
+                ++itr;
+            }
+            ++itr;
+        }
+        if (itr >= end) {
+            throw std::invalid_argument("ill-formed of basic strings");
+        }
+        string->assign(string_begin, itr);
+        return itr + 1;
+    }
+    
+    template <typename T>
+    static auto read_multiline_basic_string(std::string * string, T itr, T end) -> T {
+        itr += 3;
+        auto string_begin = itr;
+        std::size_t growth = 0;
+        while (!starts_with(itr, end, "\"\"\"")) {
+            if (itr >= end) {
+                throw std::invalid_argument("ill-formed of multi-line basic strings");
+            }
+            if (*itr == '\\') {
+                if (itr + 1 >= end) {
+                    throw std::invalid_argument("ill-formed of multi-line basic strings");
+                }
+                ++itr;
+            }
+            else if (*itr == '"' || *itr == '\r' || *itr == '\n') {
+                ++growth;
+            }
+            ++itr;
+        }
+        auto string_end = itr;
+        string_begin = skip_first_newline(string_begin, string_end);
+        
+        string->clear();
+        string->reserve(static_cast<std::size_t>(string_end - string_begin) + growth);
+        auto run = string_begin;
+        for (auto p = string_begin; p < string_end; ) {
+            char const * escaped;
+            switch (*p) {
+                case '\\': {
+                    // A backslash at the end of a line trims the newline and the following whitespace
+                    auto q = p + 1;
+                    if (q < string_end && *q == '\r') {
+                        ++q;
+                    }
+                    if (q < string_end && *q == '\n') {
+                        string->append(run, p);
+                        p = q + 1;
+                        while (p < string_end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+                            ++p;
+                        }
+                        run = p;
+                    }
+                    else {
+                        // Other escape sequences are kept as they are
+                        p += 2;
+                    }
+                    continue;
+                }
+                case '"': escaped = "\\\""; break;
+                case '\r': escaped = "\\r"; break;
+                case '\n': escaped = "\\n"; break;
+                default: ++p; continue;
+            }
+            string->append(run, p);
+            string->append(escaped, 2);
+            run = ++p;
+        }
+        string->append(run, string_end);
+        return string_end + 3;
+    }
+    
+    template <typename T>
+    static auto read_literal_string(std::string * string, T itr, T end) -> T {
+        auto string_begin = ++itr;
+        std::size_t growth = 0;
+        while (itr < end && *itr != '\'') {
+            if (*itr == '\n' || *itr == '\r') {
+                throw std::invalid_argument("ill-formed of literal strings");
+            }
+            if (*itr == '\\' || *itr == '"') {
+                ++growth;
+            }
+            ++itr;
+        }
+        if (itr >= end) {
+            throw std::invalid_argument("ill-formed of literal strings");
+        }
+        string->clear();
+        string->reserve(static_cast<std::size_t>(itr - string_begin) + growth);
+        append_literal(string, string_begin, itr);
+        return itr + 1;
+    }
+    
+    template <typename T>
+    static auto read_multiline_literal_string(std::string * string, T itr, T end) -> T {
+        itr += 3;
+        auto string_begin = itr;
+        std::size_t growth = 0;
+        while (!starts_with(itr, end, "'''")) {
+            if (itr >= end) {
+                throw std::invalid_argument("ill-formed of multi-line literal strings");
+            }
+            if (*itr == '\\' || *itr == '"' || *itr == '\r' || *itr == '\n') {
+                ++growth;
+            }
+            ++itr;
+        }
+        auto string_end = itr;
+        string_begin = skip_first_newline(string_begin, string_end);
+        
+        string->clear();
+        string->reserve(static_cast<std::size_t>(string_end - string_begin) + growth);
+        append_literal(string, string_begin, string_end);
+        return string_end + 3;
+    }
+    
     template <typename T>
     static auto read_value(std::any * value, T itr, T end) -> T {
         if (*itr == '[') {
@@ -289,80 +511,31 @@ namespace {
         else if (*itr == '{') {
             itr = read_inline_table(value, itr, end);
         }
-        else if (::strstr(itr, "\"\"\"") == itr) {
+        else if (starts_with(itr, end, "\"\"\"")) {
             // Multi-line basic strings
-            static std::regex const re(R"(^\"\"\"([\s\S]*?)\"\"\")");
-            std::cmatch m;
-            if (!std::regex_search(itr, end, m, re)) {
-                throw std::invalid_argument("ill-formed of multi-line basic strings");
-            }
-            itr = m[0].second;
-            
-            // A newline immediately following the opening delimiter will be trimmed.
-            auto string_begin = m[1].first;
-            if (m[1].second - m[1].first > 1 && *m[1].first == '\n') {
-                ++string_begin;
-            }
-            else if (m[1].second - m[1].first > 2 && m[1].first[0] == '\r' && m[1].first[1] == '\n') {
-                string_begin += 2;
-            }
-            
-            // Trim
-            auto string = std::regex_replace(std::string(string_begin, m[1].second), std::regex(R"(\\\r?\n[ \t\r\n]*)"), "");
-            string = std::regex_replace(string, std::regex("\r"), "\\r");
-            string = std::regex_replace(string, std::regex("\n"), "\\n");
+            std::string string;
+            itr = read_multiline_basic_string(&string, itr, end);
             MJTOML_LOG("string: %s\n", string.c_str());
             *value = std::move(string);
         }
         else if (*itr == '"') {
             // Basic strings
-            static std::regex const re(R"(^\"(.*?[^\\])?\")");
-            std::cmatch m;
-            if (!std::regex_search(itr, end, m, re)) {
-                throw std::invalid_argument("ill-formed of basic strings");
-            }
-            itr = m[0].second;
-            
-            auto string = std::string(m[1]);
+            std::string string;
+            itr = read_basic_string(&string, itr, end);
             MJTOML_LOG("string: %s\n", string.c_str());
             *value = std::move(string);
         }
-        else if (::strstr(itr, "'''") == itr) {
+        else if (starts_with(itr, end, "'''")) {
             // Multi-line literal strings
-            static std::regex const re(R"(^'''([\s\S]*?)''')");
-            std::cmatch m;
-            if (!std::regex_search(itr, end, m, re)) {
-                throw std::invalid_argument("ill-formed of multi-line literal strings");
-            }
-            itr = m[0].second;
-            
-            // A newline immediately following the opening delimiter will be trimmed.
-            auto string_begin = m[1].first;
-            if (m[1].second - m[1].first > 1 && *m[1].first == '\n') {
-                ++string_begin;
-            }
-            else if (m[1].second - m[1].first > 2 && m[1].first[0] == '\r' && m[1].first[1] == '\n') {
-                string_begin += 2;
-            }
-            
-            // Escape
-            auto string = std::regex_replace(std::string(string_begin, m[1].second), std::regex(R"(\\)"), "\\\\");
-            string = std::regex_replace(string, std::regex("\r"), "\\r");
-            string = std::regex_replace(string, std::regex("\n"), "\\n");
+            std::string string;
+            itr = read_multiline_literal_string(&string, itr, end);
             MJTOML_LOG("string: %s\n", string.c_str());
             *value = std::move(string);
         }
         else if (*itr == '\'') {
             // Literal strings
-            static std::regex const re(R"(^'(.*?)')");
-            std::cmatch m;
-            if (!std::regex_search(itr, end, m, re)) {
-                throw std::invalid_argument("ill-formed of literal strings");
-            }
-            itr = m[0].second;
-            
-            auto string = std::regex_replace(std::string(m[1]), std::regex(R"(\\)"), "\\\\");
-            string = std::regex_replace(string, std::regex(R"(\")"), "\\\"");
+            std::string string;
+            itr = read_literal_string(&string, itr, end);
             MJTOML_LOG("string: %s\n", string.c_str());
             *value = std::move(string);
         }
@@ -386,6 +559,16 @@ namespace {
                     }
                 }
             }
+            // Offset Date-Time, Local Date-Time, Local Date, Local Time (RFC 3339)
+            {
+                MJTomlDateTime datetime;
+                auto datetime_end = read_datetime(&datetime, itr, end);
+                if (datetime_end != itr) {
+                    MJTOML_LOG("datetime: %s\n", datetime.value.c_str());
+                    *value = std::move(datetime);
+                    return datetime_end;
+                }
+            }
             // Float
             {
                 {
@@ -428,54 +611,26 @@ namespace {
                     if (m[2].length() != 0) {
                         auto integer = std::string(m[2]);
                         MJTOML_LOG("hexadecimal: 0x%s\n", integer.c_str());
-                        *value = std::stoll(std::regex_replace(integer, std::regex("_"), ""), 0, 16);
+                        *value = static_cast<MJTomlInteger>(std::stoll(std::regex_replace(integer, std::regex("_"), ""), 0, 16));
                     }
                     else if (m[3].length() != 0) {
                         auto integer = std::string(m[3]);
                         MJTOML_LOG("octal: 0o%s\n", integer.c_str());
-                        *value = std::stoll(std::regex_replace(integer, std::regex("_"), ""), 0, 8);
+                        *value = static_cast<MJTomlInteger>(std::stoll(std::regex_replace(integer, std::regex("_"), ""), 0, 8));
                     }
                     else if (m[4].length() != 0) {
                         auto integer = std::string(m[4]);
                         MJTOML_LOG("binary: 0b%s\n", integer.c_str());
-                        *value = std::stoll(std::regex_replace(integer, std::regex("_"), ""), 0, 2);
+                        *value = static_cast<MJTomlInteger>(std::stoll(std::regex_replace(integer, std::regex("_"), ""), 0, 2));
                     }
                     else if (m[5].length() != 0) {
                         auto integer = std::string(m[5]);
                         MJTOML_LOG("integer: %s\n", integer.c_str());
-                        *value = std::stoll(std::regex_replace(integer, std::regex("_"), ""));
+                        *value = static_cast<MJTomlInteger>(std::stoll(std::regex_replace(integer, std::regex("_"), "")));
                     }
                     return m[1].second;
                 }
             }
-            // Offset Date-Time, Local Date-Time, Local Date, Local Time (RFC 3339)
-            {
-                // Offset Date-Time, Local Date-Time
-                {
-                    static std::regex const re(R"(^(\d{4}-\d{2}-\d{2}[T ]\d{2}:\d{2}:\d{2}(?:\.\d{1,6})?(?:Z|[+-]\d{2}:\d{2})?)[\t\r\n #,\]])");
-                    std::cmatch m;
-                    if (std::regex_search(itr, end, m, re)) {
-                        auto datetime = std::string(m[1]);
-                        MJTOML_LOG("datetime: %s\n", datetime.c_str());
-                        
-                        *value = MJTomlDateTime{datetime};
-                        return m[1].second;
-                    }
-                }
-                // Local Date, Local Time
-                {
-                    static std::regex const re(R"(^(\d{4}-\d{2}-\d{2}|\d{2}:\d{2}:\d{2}(?:\.\d{1,6})?)[\t\r\n #,\]])");
-                    std::cmatch m;
-                    if (std::regex_search(itr, end, m, re)) {
-                        auto datetime = std::string(m[1]);
-                        MJTOML_LOG("datetime: %s\n", datetime.c_str());
-                        
-                        *value = MJTomlDateTime{datetime};
-                        return m[1].second;
-                    }
-                }
-            }
-            
             throw std::logic_error("not implemented");
         }
         
@@ -663,147 +818,1429 @@ namespace {
         throw std::invalid_argument("ill-formed of inline table");
     }
     
+    template <typename T>
+    static auto read_digits(T itr, T end, int count, int * result) -> bool {
+        if (end - itr < count) {
+            return false;
+        }
+        int value = 0;
+        for (int i = 0; i < count; ++i) {
+            if (itr[i] < '0' || itr[i] > '9') {
+                return false;
+            }
+            value = value * 10 + (itr[i] - '0');
+        }
+        *result = value;
+        return true;
+    }
+    
+    template <typename T>
+    static auto is_value_terminator(T itr, T end) -> bool {
+        return itr == end || *itr == '\t' || *itr == '\r' || *itr == '\n' || *itr == ' ' || *itr == '#' || *itr == ',' || *itr == ']';
+    }
+    
+    // Reads a partial-time, returns itr if it is not a time.
+    template <typename T>
+    static auto read_time(MJTomlDateTime * datetime, T itr, T end) -> T {
+        int hour, minute, second;
+        if (!read_digits(itr, end, 2, &hour) || itr + 2 >= end || itr[2] != ':'
+            || !read_digits(itr + 3, end, 2, &minute) || itr + 5 >= end || itr[5] != ':'
+            || !read_digits(itr + 6, end, 2, &second)) {
+            return itr;
+        }
+        if (hour > 23 || minute > 59 || second > 60) {
+            throw std::invalid_argument("ill-formed of time");
+        }
+        datetime->hour = static_cast<std::uint8_t>(hour);
+        datetime->minute = static_cast<std::uint8_t>(minute);
+        datetime->second = static_cast<std::uint8_t>(second);
+        datetime->nanosecond = 0;
+        
+        auto time_end = itr + 8;
+        if (time_end < end && *time_end == '.') {
+            ++time_end;
+            auto fraction_begin = time_end;
+            std::uint32_t scale = 100000000;
+            while (time_end < end && *time_end >= '0' && *time_end <= '9') {
+                // Digits beyond nanoseconds are truncated
+                datetime->nanosecond += (*time_end - '0') * scale;
+                scale /= 10;
+                ++time_end;
+            }
+            if (time_end == fraction_begin) {
+                throw std::invalid_argument("ill-formed of time");
+            }
+        }
+        return time_end;
+    }
+    
+    // Hand-written RFC 3339 parser, returns itr if it is not a date-time.
+    template <typename T>
+    static auto read_datetime(MJTomlDateTime * datetime, T itr, T end) -> T {
+        static std::uint8_t const days_in_month[] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+        
+        T datetime_end;
+        int year, month, day;
+        if (read_digits(itr, end, 4, &year) && itr + 4 < end && itr[4] == '-'
+            && read_digits(itr + 5, end, 2, &month) && itr + 7 < end && itr[7] == '-'
+            && read_digits(itr + 8, end, 2, &day)) {
+            if (month < 1 || month > 12 || day < 1 || day > days_in_month[month - 1]
+                || (month == 2 && day == 29 && !(year % 4 == 0 && (year % 100 != 0 || year % 400 == 0)))) {
+                throw std::invalid_argument("ill-formed of date");
+            }
+            datetime->year = year;
+            datetime->month = static_cast<std::uint8_t>(month);
+            datetime->day = static_cast<std::uint8_t>(day);
+            datetime->hour = 0;
+            datetime->minute = 0;
+            datetime->second = 0;
+            datetime->nanosecond = 0;
+            datetime->offset_minutes = 0;
+            datetime->kind = MJTomlDateTimeKind::local_date;
+            datetime_end = itr + 10;
+            
+            if (datetime_end < end && (*datetime_end == 'T' || *datetime_end == 't' || *datetime_end == ' ')) {
+                auto time_end = read_time(datetime, datetime_end + 1, end);
+                if (time_end != datetime_end + 1) {
+                    datetime->kind = MJTomlDateTimeKind::local_date_time;
+                    datetime_end = time_end;
+                    
+                    if (datetime_end < end && (*datetime_end == 'Z' || *datetime_end == 'z')) {
+                        datetime->kind = MJTomlDateTimeKind::offset_date_time;
+                        ++datetime_end;
+                    }
+                    else if (datetime_end < end && (*datetime_end == '+' || *datetime_end == '-')) {
+                        int offset_hour, offset_minute;
+                        if (!read_digits(datetime_end + 1, end, 2, &offset_hour) || datetime_end + 3 >= end || datetime_end[3] != ':'
+                            || !read_digits(datetime_end + 4, end, 2, &offset_minute) || offset_hour > 23 || offset_minute > 59) {
+                            throw std::invalid_argument("ill-formed of offset date-time");
+                        }
+                        auto offset_minutes = offset_hour * 60 + offset_minute;
+                        datetime->offset_minutes = static_cast<std::int16_t>(*datetime_end == '-' ? -offset_minutes : offset_minutes);
+                        datetime->kind = MJTomlDateTimeKind::offset_date_time;
+                        datetime_end += 6;
+                    }
+                }
+                else if (*datetime_end != ' ') {
+                    throw std::invalid_argument("ill-formed of date-time");
+                }
+            }
+        }
+        else {
+            datetime->year = 0;
+            datetime->month = 0;
+            datetime->day = 0;
+            datetime->offset_minutes = 0;
+            datetime->kind = MJTomlDateTimeKind::local_time;
+            datetime_end = read_time(datetime, itr, end);
+            if (datetime_end == itr) {
+                return itr;
+            }
+        }
+        
+        if (!is_value_terminator(datetime_end, end)) {
+            throw std::invalid_argument("ill-formed of date-time");
+        }
+        datetime->value = std::string(itr, datetime_end);
+        return datetime_end;
+    }
+    
     // MARK: -
     
-    static auto convert_types(MJTomlTable * table) -> void;
-    static auto convert_types(MJTomlArray * array) -> void;
+    static auto convert_types(MJTomlTable * table, MJTomlStats * stats) -> void;
+    static auto convert_types(MJTomlArray * array, MJTomlStats * stats) -> void;
+    static auto count_value(std::any const & value, MJTomlStats * stats) -> void;
     
-    static auto convert_types(MJTomlTable * table) -> void {
+    static auto convert_types(MJTomlTable * table, MJTomlStats * stats) -> void {
+        if (stats != nullptr) {
+            ++stats->tables;
+        }
         for (auto itr = table->begin(); itr != table->end(); ++itr) {
             if (itr->second.type() == typeid(MJTomlTable)) {
-                convert_types(std::any_cast<MJTomlTable>(&itr->second));
+                convert_types(std::any_cast<MJTomlTable>(&itr->second), stats);
             }
             else if (itr->second.type() == typeid(MJTomlArrayParsing)) {
                 itr->second = std::any_cast<MJTomlArrayParsing>(&itr->second)->values;
-                convert_types(std::any_cast<MJTomlArray>(&itr->second));
+                convert_types(std::any_cast<MJTomlArray>(&itr->second), stats);
+            }
+            else if (stats != nullptr) {
+                count_value(itr->second, stats);
             }
         }
     }
     
-    static auto convert_types(MJTomlArray * array) -> void {
+    static auto convert_types(MJTomlArray * array, MJTomlStats * stats) -> void {
+        if (stats != nullptr) {
+            ++stats->arrays;
+        }
         for (auto itr = array->begin(); itr != array->end(); ++itr) {
             if (itr->type() == typeid(MJTomlTable)) {
-                convert_types(std::any_cast<MJTomlTable>(&*itr));
+                convert_types(std::any_cast<MJTomlTable>(&*itr), stats);
             }
             else if (itr->type() == typeid(MJTomlArrayParsing)) {
                 *itr = std::any_cast<MJTomlArrayParsing>(&*itr)->values;
-                convert_types(std::any_cast<MJTomlArray>(&*itr));
+                convert_types(std::any_cast<MJTomlArray>(&*itr), stats);
+            }
+            else if (stats != nullptr) {
+                count_value(*itr, stats);
             }
         }
     }
     
-    // MARK: -
+    static auto count_value(std::any const & value, MJTomlStats * stats) -> void {
+        if (value.type() == typeid(MJTomlString)) {
+            ++stats->strings;
+        }
+        else if (value.type() == typeid(MJTomlInteger)) {
+            ++stats->integers;
+        }
+        else if (value.type() == typeid(MJTomlFloat) || value.type() == typeid(MJTomlDescribedFloat)) {
+            ++stats->floats;
+        }
+        else if (value.type() == typeid(MJTomlBoolean)) {
+            ++stats->booleans;
+        }
+        else if (value.type() == typeid(MJTomlDateTime)) {
+            ++stats->datetimes;
+        }
+    }
     
-    static auto string_json(MJTomlTable const & table, int indent, bool is_strict) -> std::string;
-    static auto string_json(MJTomlArray const & array, int indent, bool is_strict) -> std::string;
-    static auto string_json(std::any const & value, int indent, bool is_strict) -> std::string;
+    // Counts the bytes written through it
+    class MJTomlCountingBuffer : public std::streambuf {
+    public:
+        explicit MJTomlCountingBuffer(std::streambuf * buffer) : buffer_(buffer), count_(0) {}
+        auto count() const -> std::uint64_t {
+            return count_;
+        }
+    protected:
+        auto overflow(int_type c) -> int_type override {
+            if (traits_type::eq_int_type(c, traits_type::eof())) {
+                return traits_type::not_eof(c);
+            }
+            ++count_;
+            return buffer_->sputc(traits_type::to_char_type(c));
+        }
+        auto xsputn(char const * s, std::streamsize n) -> std::streamsize override {
+            auto written = buffer_->sputn(s, n);
+            count_ += written;
+            return written;
+        }
+        auto sync() -> int override {
+            return buffer_->pubsync();
+        }
+    private:
+        std::streambuf * buffer_;
+        std::uint64_t count_;
+    };
     
-    static auto string_json(MJTomlTable const & table, int indent, bool is_strict) -> std::string {
-        std::stringstream ss;
-        std::string joiner = "\n";
-        
-        std::string root_space;
-        for (int i = 0; i < indent; ++i) {
-            root_space += "  ";
+    // Measures the time, allocations and bytes written by the writer, calls it directly if stats is nullptr
+    template <typename F>
+    static auto measure_write(std::ostream & os, MJTomlStats * stats, F && write) -> void {
+        if (stats == nullptr) {
+            write(os);
+            return;
         }
-        std::string space = root_space + "  ";
-        
-        ss << "{";
-        for (auto itr = table.begin(); itr != table.end(); ++itr) {
-            ss << joiner << space << "\"" << itr->first << "\": ";
-            ss << string_json(itr->second, indent, is_strict);
-            joiner = ",\n";
+        auto allocations = stats->allocation_counter != nullptr ? stats->allocation_counter() : 0;
+        MJTomlCountingBuffer buffer(os.rdbuf());
+        std::ostream counting_os(&buffer);
+        counting_os.copyfmt(os);
+        {
+            MJTomlStopwatch stopwatch(&stats->write_ns);
+            write(counting_os);
         }
-        ss << std::endl << root_space << "}";
-        return ss.str();
-    }
-        
-    static auto string_json(MJTomlArray const & array, int indent, bool is_strict) -> std::string {
-        std::stringstream ss;
-        std::string joiner = "\n";
-        
-        std::string root_space;
-        for (int i = 0; i < indent; ++i) {
-            root_space += "  ";
+        if (!counting_os) {
+            os.setstate(counting_os.rdstate());
         }
-        std::string space = root_space + "  ";
-        
-        ss << "[";
-        for (auto itr = array.begin(); itr != array.end(); ++itr) {
-            ss << joiner << space;
-            ss << string_json(*itr, indent, is_strict);
-            joiner = ",\n";
+        stats->bytes_written += buffer.count();
+        if (stats->allocation_counter != nullptr) {
+            stats->write_allocations += stats->allocation_counter() - allocations;
         }
-        ss << std::endl << root_space << "]";
-        return ss.str();
     }
-        
-    static auto string_json(std::any const & value, int indent, bool is_strict) -> std::string {
-        std::stringstream ss;
+    
+    // MARK: -
+    
+    static auto share_value(std::any value) -> std::any;
+    
+    static auto share_table(MJTomlTable table) -> MJTomlTable {
+        for (auto itr = table.begin(); itr != table.end(); ++itr) {
+            itr->second = share_value(std::move(itr->second));
+        }
+        return table;
+    }
+    
+    static auto share_value(std::any value) -> std::any {
         if (value.type() == typeid(MJTomlTable)) {
-            ss << string_json(*std::any_cast<MJTomlTable>(&value), indent + 1, is_strict);
+            auto table = share_table(std::move(*std::any_cast<MJTomlTable>(&value)));
+            return MJTomlSharedTable{std::make_shared<MJTomlTable const>(std::move(table))};
         }
         else if (value.type() == typeid(MJTomlArray)) {
-            ss << string_json(*std::any_cast<MJTomlArray>(&value), indent + 1, is_strict);
+            auto array = std::move(*std::any_cast<MJTomlArray>(&value));
+            for (auto itr = array.begin(); itr != array.end(); ++itr) {
+                *itr = share_value(std::move(*itr));
+            }
+            return MJTomlSharedArray{std::make_shared<MJTomlArray const>(std::move(array))};
         }
-        else if (value.type() == typeid(MJTomlString)) {
-            auto str_ptr = std::any_cast<MJTomlString>(&value);
-            ss << "\"" << *str_ptr << "\"";
+        return value;
+    }
+    
+    static auto table_ptr(std::any const & value) -> MJTomlTable const * {
+        if (value.type() == typeid(MJTomlTable)) {
+            return std::any_cast<MJTomlTable>(&value);
         }
-        else if (value.type() == typeid(MJTomlBoolean)) {
-            auto bool_ptr = std::any_cast<MJTomlBoolean>(&value);
-            ss << (*bool_ptr ? "true" : "false");
+        else if (value.type() == typeid(MJTomlSharedTable)) {
+            return std::any_cast<MJTomlSharedTable>(&value)->table.get();
         }
-        else if (value.type() == typeid(MJTomlInteger)) {
-            auto int_ptr = std::any_cast<MJTomlInteger>(&value);
-            ss << *int_ptr;
+        return nullptr;
+    }
+    
+    static auto overlay_table(MJTomlTable const & base, MJTomlTable const & overlay) -> MJTomlTable {
+        // The values of a shared base are shared_ptr, copying them does not copy the subtrees.
+        // The subtrees of a plain base are copied once and frozen, so the result is always shared.
+        MJTomlTable table;
+        for (auto itr = base.begin(); itr != base.end(); ++itr) {
+            table.emplace_hint(table.end(), itr->first, share_value(itr->second));
         }
-        else if (value.type() == typeid(MJTomlFloat)) {
-            auto flt_ptr = std::any_cast<MJTomlFloat>(&value);
-            if (std::isinf(*flt_ptr)) {
-                if (is_strict) {
-                    ss << "\"" << (*flt_ptr < 0 ? "-" : "") << "Infinity" << "\"";
-                }
-                else {
-                    ss << (*flt_ptr < 0 ? "-" : "") << "Infinity";
-                }
-            }
-            else if (std::isnan(*flt_ptr)) {
-                if (is_strict) {
-                    ss << "\"NaN\"";
-                }
-                else {
-                    ss << "NaN";
-                }
+        for (auto itr = overlay.begin(); itr != overlay.end(); ++itr) {
+            auto base_itr = table.find(itr->first);
+            auto base_table = base_itr != table.end() ? table_ptr(base_itr->second) : nullptr;
+            auto overlay_table_ptr = table_ptr(itr->second);
+            if (base_table != nullptr && overlay_table_ptr != nullptr) {
+                auto merged = overlay_table(*base_table, *overlay_table_ptr);
+                base_itr->second = MJTomlSharedTable{std::make_shared<MJTomlTable const>(std::move(merged))};
             }
             else {
-                ss << std::scientific << std::setprecision(std::numeric_limits<double>::max_digits10) << *flt_ptr;
+                table[itr->first] = share_value(itr->second);
             }
         }
-        else if (value.type() == typeid(MJTomlDescribedFloat)) {
-            auto flt_ptr = std::any_cast<MJTomlDescribedFloat>(&value);
-            ss << flt_ptr->description;
+        return table;
+    }
+    
+    // MARK: -
+    
+    // Days since 1970-01-01 in the proleptic Gregorian calendar
+    static auto days_from_civil(std::int64_t year, unsigned month, unsigned day) -> std::int64_t {
+        year -= month <= 2;
+        auto era = (year >= 0 ? year : year - 399) / 400;
+        auto year_of_era = static_cast<unsigned>(year - era * 400);
+        auto day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+        auto day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+        return era * 146097 + static_cast<std::int64_t>(day_of_era) - 719468;
+    }
+    
+    // The JSON writer is shared by the sinks: the stream, the exact size measurement and the pre-allocated buffer
+    struct MJTomlStreamSink {
+        std::ostream * os;
+        auto write(char const * str, std::size_t length) -> void {
+            os->write(str, static_cast<std::streamsize>(length));
         }
-        else if (value.type() == typeid(MJTomlDateTime)) {
-            auto dt_ptr = std::any_cast<MJTomlDateTime>(&value);
-            ss << "\"" << dt_ptr->value << "\"";
+        auto put(char c) -> void {
+            os->put(c);
+        }
+    };
+    
+    struct MJTomlCountingSink {
+        std::size_t size = 0;
+        auto write(char const *, std::size_t length) -> void {
+            size += length;
+        }
+        auto put(char) -> void {
+            ++size;
+        }
+    };
+    
+    // Writes without bounds checks, the buffer must have the size measured by MJTomlCountingSink
+    struct MJTomlPointerSink {
+        char * ptr;
+        auto write(char const * str, std::size_t length) -> void {
+            std::memcpy(ptr, str, length);
+            ptr += length;
+        }
+        auto put(char c) -> void {
+            *ptr++ = c;
+        }
+    };
+    
+    // Unmaps the file on every exit path, including a throwing fill
+    class MJTomlMapping {
+    public:
+        MJTomlMapping() = default;
+        MJTomlMapping(MJTomlMapping const &) = delete;
+        MJTomlMapping & operator=(MJTomlMapping const &) = delete;
+        ~MJTomlMapping() {
+            if (ptr_ != MAP_FAILED) {
+                ::munmap(ptr_, size_);
+            }
+        }
+        auto map(int fd, std::size_t size) -> char * {
+            ptr_ = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (ptr_ == MAP_FAILED) {
+                throw std::runtime_error(std::string("mmap failed: ") + std::strerror(errno));
+            }
+            size_ = size;
+            return static_cast<char *>(ptr_);
         }
-        return ss.str();
+    private:
+        void * ptr_ = MAP_FAILED;
+        std::size_t size_ = 0;
+    };
+    
+    template <typename S, std::size_t N>
+    static auto write_literal(S & sink, char const (&str)[N]) -> void {
+        sink.write(str, N - 1);
     }
-}
-
-namespace MoonJelly {
     
-MJToml parse_toml(std::string_view str) {
-    MJToml toml;
+    template <typename S>
+    static auto write_string(S & sink, std::string const & str) -> void {
+        sink.write(str.data(), str.size());
+    }
+    
+    template <typename S>
+    static auto write_integer(S & sink, std::int64_t value) -> void {
+        char buf[24];
+        auto result = std::to_chars(buf, buf + sizeof(buf), value);
+        sink.write(buf, static_cast<std::size_t>(result.ptr - buf));
+    }
+    
+    static auto write_integer(MJTomlCountingSink & sink, std::int64_t value) -> void {
+        auto magnitude = value < 0 ? 0 - static_cast<std::uint64_t>(value) : static_cast<std::uint64_t>(value);
+        sink.size += value < 0 ? 2 : 1;
+        while (magnitude >= 10) {
+            magnitude /= 10;
+            ++sink.size;
+        }
+    }
+    
+    template <typename S>
+    static auto write_epoch_json(S & sink, MJTomlDateTime const & datetime) -> void {
+        auto seconds = epoch_seconds(datetime);
+        if (datetime.nanosecond == 0) {
+            write_integer(sink, seconds);
+            return;
+        }
+        // seconds is floored, e.g. -1.25 is (-2, 750000000)
+        auto nanosecond = datetime.nanosecond;
+        if (seconds < 0) {
+            ++seconds;
+            nanosecond = 1000000000 - nanosecond;
+            sink.put('-');
+        }
+        char fraction[11];
+        std::snprintf(fraction, sizeof(fraction), ".%09u", static_cast<unsigned>(nanosecond));
+        auto length = std::strlen(fraction);
+        while (fraction[length - 1] == '0') {
+            --length;
+        }
+        write_integer(sink, seconds < 0 ? -seconds : seconds);
+        sink.write(fraction, length);
+    }
+    
+    template <typename S>
+    static auto write_indent(S & sink, int indent) -> void {
+        for (int i = 0; i < indent; ++i) {
+            write_literal(sink, "  ");
+        }
+    }
+    
+    static auto write_indent(MJTomlCountingSink & sink, int indent) -> void {
+        sink.size += 2 * static_cast<std::size_t>(indent);
+    }
+    
+    template <typename S>
+    static auto write_json(S & sink, MJTomlTable const & table, int indent, bool is_strict, bool is_epoch) -> void;
+    template <typename S>
+    static auto write_json(S & sink, MJTomlArray const & array, int indent, bool is_strict, bool is_epoch) -> void;
+    template <typename S>
+    static auto write_json(S & sink, std::any const & value, int indent, bool is_strict, bool is_epoch) -> void;
+    
+    template <typename S>
+    static auto write_json(S & sink, MJTomlTable const & table, int indent, bool is_strict, bool is_epoch) -> void {
+        auto is_first = true;
+        
+        sink.put('{');
+        for (auto itr = table.begin(); itr != table.end(); ++itr) {
+            if (is_first) {
+                sink.put('\n');
+            }
+            else {
+                write_literal(sink, ",\n");
+            }
+            write_indent(sink, indent + 1);
+            sink.put('"');
+            write_string(sink, itr->first);
+            write_literal(sink, "\": ");
+            write_json(sink, itr->second, indent, is_strict, is_epoch);
+            is_first = false;
+        }
+        sink.put('\n');
+        write_indent(sink, indent);
+        sink.put('}');
+    }
+    
+    template <typename S>
+    static auto write_json(S & sink, MJTomlArray const & array, int indent, bool is_strict, bool is_epoch) -> void {
+        auto is_first = true;
+        
+        sink.put('[');
+        for (auto itr = array.begin(); itr != array.end(); ++itr) {
+            if (is_first) {
+                sink.put('\n');
+            }
+            else {
+                write_literal(sink, ",\n");
+            }
+            write_indent(sink, indent + 1);
+            write_json(sink, *itr, indent, is_strict, is_epoch);
+            is_first = false;
+        }
+        sink.put('\n');
+        write_indent(sink, indent);
+        sink.put(']');
+    }
+    
+    template <typename S>
+    static auto write_json(S & sink, std::any const & value, int indent, bool is_strict, bool is_epoch) -> void {
+        if (value.type() == typeid(MJTomlTable)) {
+            write_json(sink, *std::any_cast<MJTomlTable>(&value), indent + 1, is_strict, is_epoch);
+        }
+        else if (value.type() == typeid(MJTomlSharedTable)) {
+            write_json(sink, *std::any_cast<MJTomlSharedTable>(&value)->table, indent + 1, is_strict, is_epoch);
+        }
+        else if (value.type() == typeid(MJTomlArray)) {
+            write_json(sink, *std::any_cast<MJTomlArray>(&value), indent + 1, is_strict, is_epoch);
+        }
+        else if (value.type() == typeid(MJTomlSharedArray)) {
+            write_json(sink, *std::any_cast<MJTomlSharedArray>(&value)->array, indent + 1, is_strict, is_epoch);
+        }
+        else if (value.type() == typeid(MJTomlString)) {
+            auto str_ptr = std::any_cast<MJTomlString>(&value);
+            // Strings are kept escaped, the size does not change
+            sink.put('"');
+            write_string(sink, *str_ptr);
+            sink.put('"');
+        }
+        else if (value.type() == typeid(MJTomlBoolean)) {
+            auto bool_ptr = std::any_cast<MJTomlBoolean>(&value);
+            if (*bool_ptr) {
+                write_literal(sink, "true");
+            }
+            else {
+                write_literal(sink, "false");
+            }
+        }
+        else if (value.type() == typeid(MJTomlInteger)) {
+            auto int_ptr = std::any_cast<MJTomlInteger>(&value);
+            write_integer(sink, *int_ptr);
+        }
+        else if (value.type() == typeid(MJTomlFloat)) {
+            auto flt_ptr = std::any_cast<MJTomlFloat>(&value);
+            if (std::isinf(*flt_ptr)) {
+                if (is_strict) {
+                    sink.put('"');
+                }
+                if (*flt_ptr < 0) {
+                    sink.put('-');
+                }
+                write_literal(sink, "Infinity");
+                if (is_strict) {
+                    sink.put('"');
+                }
+            }
+            else if (std::isnan(*flt_ptr)) {
+                if (is_strict) {
+                    write_literal(sink, "\"NaN\"");
+                }
+                else {
+                    write_literal(sink, "NaN");
+                }
+            }
+            else {
+                // Same as std::scientific with max_digits10
+                char buf[32];
+                auto length = std::snprintf(buf, sizeof(buf), "%.*e", std::numeric_limits<double>::max_digits10, *flt_ptr);
+                sink.write(buf, static_cast<std::size_t>(length));
+            }
+        }
+        else if (value.type() == typeid(MJTomlDescribedFloat)) {
+            auto flt_ptr = std::any_cast<MJTomlDescribedFloat>(&value);
+            write_string(sink, flt_ptr->description);
+        }
+        else if (value.type() == typeid(MJTomlDateTime)) {
+            auto dt_ptr = std::any_cast<MJTomlDateTime>(&value);
+            if (is_epoch && dt_ptr->kind == MJTomlDateTimeKind::offset_date_time) {
+                write_epoch_json(sink, *dt_ptr);
+            }
+            else {
+                sink.put('"');
+                write_string(sink, dt_ptr->value);
+                sink.put('"');
+            }
+        }
+    }
+    
+    static auto write_json(std::ostream & os, MJTomlTable const & table, int indent, bool is_strict, bool is_epoch) -> void {
+        MJTomlStreamSink sink{&os};
+        write_json(sink, table, indent, is_strict, is_epoch);
+    }
+    
+    static auto write_json(std::ostream & os, std::any const & value, int indent, bool is_strict, bool is_epoch) -> void {
+        MJTomlStreamSink sink{&os};
+        write_json(sink, value, indent, is_strict, is_epoch);
+    }
+    
+    // Measures the exact size first, then writes into the buffer allocated by the allocate function
+    template <typename T, typename A>
+    static auto write_json_exact(T const & value, int indent, bool is_strict, bool is_epoch, A && allocate) -> std::size_t {
+        MJTomlCountingSink counting_sink;
+        write_json(counting_sink, value, indent, is_strict, is_epoch);
+        
+        MJTomlPointerSink pointer_sink{allocate(counting_sink.size)};
+        auto begin = pointer_sink.ptr;
+        write_json(pointer_sink, value, indent, is_strict, is_epoch);
+        if (static_cast<std::size_t>(pointer_sink.ptr - begin) != counting_sink.size) {
+            throw std::logic_error("The measured size is different from the written size");
+        }
+        return counting_sink.size;
+    }
+    
+    // MARK: - Parallel JSON
+    
+    // Appends to the string directly, so the buffer is not copied by str()
+    class MJTomlStringBuffer : public std::streambuf {
+    public:
+        explicit MJTomlStringBuffer(std::string * str) : str_(str) {}
+        auto reset(std::string * str) -> void {
+            str_ = str;
+        }
+    protected:
+        auto overflow(int_type c) -> int_type override {
+            if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                str_->push_back(traits_type::to_char_type(c));
+            }
+            return traits_type::not_eof(c);
+        }
+        auto xsputn(char const * s, std::streamsize n) -> std::streamsize override {
+            str_->append(s, static_cast<std::size_t>(n));
+            return n;
+        }
+    private:
+        std::string * str_;
+    };
+    
+    // Consecutive children are grouped into a task until their estimated size reaches this
+    static std::size_t const PARALLEL_JSON_TASK_SIZE = 256 * 1024;
+    // Subtrees estimated larger than this are split into their children
+    static std::size_t const PARALLEL_JSON_SPLIT_SIZE = 4 * 1024 * 1024;
+    
+    static auto array_ptr(std::any const & value) -> MJTomlArray const * {
+        if (value.type() == typeid(MJTomlArray)) {
+            return std::any_cast<MJTomlArray>(&value);
+        }
+        else if (value.type() == typeid(MJTomlSharedArray)) {
+            return std::any_cast<MJTomlSharedArray>(&value)->array.get();
+        }
+        return nullptr;
+    }
+    
+    // Rough size of the JSON, stops counting once it exceeds the limit
+    static auto estimate_json_size(std::any const & value, int indent, std::size_t limit) -> std::size_t {
+        if (auto table = table_ptr(value)) {
+            std::size_t size = 2 * indent + 4;
+            for (auto itr = table->begin(); itr != table->end() && size <= limit; ++itr) {
+                size += 2 * (indent + 1) + itr->first.size() + 6;
+                size += estimate_json_size(itr->second, indent + 1, limit - std::min(limit, size));
+            }
+            return size;
+        }
+        else if (auto array = array_ptr(value)) {
+            std::size_t size = 2 * indent + 4;
+            for (auto itr = array->begin(); itr != array->end() && size <= limit; ++itr) {
+                size += 2 * (indent + 1) + 2;
+                size += estimate_json_size(*itr, indent + 1, limit - std::min(limit, size));
+            }
+            return size;
+        }
+        else if (value.type() == typeid(MJTomlString)) {
+            return std::any_cast<MJTomlString>(&value)->size() + 2;
+        }
+        else if (value.type() == typeid(MJTomlDescribedFloat)) {
+            return std::any_cast<MJTomlDescribedFloat>(&value)->description.size();
+        }
+        else if (value.type() == typeid(MJTomlDateTime)) {
+            return std::any_cast<MJTomlDateTime>(&value)->value.size() + 2;
+        }
+        return 24;
+    }
+    
+    struct MJTomlJsonPlan {
+        // Written in order, the task results are stored in their own buffers.
+        // deque keeps the buffers in place while appending.
+        std::deque<std::string> buffers;
+        std::vector<std::pair<std::size_t, std::function<void(std::ostream &)>>> tasks;
+    };
+    
+    static auto child_value(MJTomlTable::const_iterator itr) -> std::any const & {
+        return itr->second;
+    }
+    
+    static auto child_value(MJTomlArray::const_iterator itr) -> std::any const & {
+        return *itr;
+    }
+    
+    static auto plan_json(MJTomlJsonPlan * plan, std::any const & value, int indent, bool is_strict, bool is_epoch) -> void;
+    
+    // Mirrors write_json(MJTomlTable) and write_json(MJTomlArray), but hands runs of children to the tasks.
+    // Only the brackets and the heads of the split children are written by the planning thread.
+    template <typename C, typename W>
+    static auto plan_json_container(MJTomlJsonPlan * plan, C const & container, int indent, char const * open, char const * close, W && write_key, bool is_strict, bool is_epoch) -> void {
+        MJTomlStringBuffer buffer(&plan->buffers.back());
+        std::ostream os(&buffer);
+        auto chunk_begin = container.begin();
+        std::size_t chunk_size = 0;
+        
+        // The children in [chunk_begin, chunk_end) are written by a task, including their joiners
+        auto add_task = [&](typename C::const_iterator chunk_end) {
+            if (chunk_begin == chunk_end) {
+                return;
+            }
+            auto is_first = chunk_begin == container.begin();
+            plan->tasks.emplace_back(plan->buffers.size(), [=, first = chunk_begin](std::ostream & os) {
+                for (auto itr = first; itr != chunk_end; ++itr) {
+                    os << (is_first && itr == first ? "\n" : ",\n");
+                    write_indent(os, indent + 1);
+                    write_key(os, itr);
+                    write_json(os, child_value(itr), indent, is_strict, is_epoch);
+                }
+            });
+            plan->buffers.emplace_back();
+            plan->buffers.emplace_back();
+            buffer.reset(&plan->buffers.back());
+            chunk_begin = chunk_end;
+            chunk_size = 0;
+        };
+        
+        os << open;
+        for (auto itr = container.begin(); itr != container.end(); ++itr) {
+            auto const & child = child_value(itr);
+            auto size = estimate_json_size(child, indent + 1, PARALLEL_JSON_SPLIT_SIZE);
+            if (size > PARALLEL_JSON_SPLIT_SIZE && (table_ptr(child) != nullptr || array_ptr(child) != nullptr)) {
+                add_task(itr);
+                os << (itr == container.begin() ? "\n" : ",\n");
+                write_indent(os, indent + 1);
+                write_key(os, itr);
+                plan_json(plan, child, indent, is_strict, is_epoch);
+                // The plan may have appended buffers, continue writing to the last one
+                buffer.reset(&plan->buffers.back());
+                chunk_begin = std::next(itr);
+            }
+            else {
+                chunk_size += size;
+                if (chunk_size >= PARALLEL_JSON_TASK_SIZE) {
+                    add_task(std::next(itr));
+                }
+            }
+        }
+        add_task(container.end());
+        os << "\n";
+        write_indent(os, indent);
+        os << close;
+    }
+    
+    static auto plan_json(MJTomlJsonPlan * plan, std::any const & value, int indent, bool is_strict, bool is_epoch) -> void {
+        if (auto table = table_ptr(value)) {
+            plan_json_container(plan, *table, indent + 1, "{", "}", [](std::ostream & os, MJTomlTable::const_iterator itr) {
+                os << "\"" << itr->first << "\": ";
+            }, is_strict, is_epoch);
+        }
+        else if (auto array = array_ptr(value)) {
+            plan_json_container(plan, *array, indent + 1, "[", "]", [](std::ostream &, MJTomlArray::const_iterator) {
+            }, is_strict, is_epoch);
+        }
+        else {
+            MJTomlStringBuffer buffer(&plan->buffers.back());
+            std::ostream os(&buffer);
+            write_json(os, value, indent, is_strict, is_epoch);
+        }
+    }
+    
+    static auto write_all(int fd, std::deque<std::string> const & buffers) -> bool {
+        std::vector<struct iovec> iov;
+        iov.reserve(buffers.size());
+        for (auto const & buffer : buffers) {
+            if (!buffer.empty()) {
+                iov.push_back({const_cast<char *>(buffer.data()), buffer.size()});
+            }
+        }
+        
+        std::size_t index = 0;
+        while (index < iov.size()) {
+            auto count = static_cast<int>(std::min<std::size_t>(iov.size() - index, IOV_MAX));
+            auto written = ::writev(fd, &iov[index], count);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            // Skip the written buffers, a partial write leaves the rest of the buffer
+            auto remaining = static_cast<std::size_t>(written);
+            while (index < iov.size() && remaining >= iov[index].iov_len) {
+                remaining -= iov[index].iov_len;
+                ++index;
+            }
+            if (remaining > 0) {
+                iov[index].iov_base = static_cast<char *>(iov[index].iov_base) + remaining;
+                iov[index].iov_len -= remaining;
+            }
+        }
+        return true;
+    }
+    
+    static auto write_json_parallel(int fd, MJTomlTable const & table, int jobs, int indent, bool is_strict, bool is_epoch) -> std::uint64_t {
+        // The root is wrapped to share plan_json with the children, plan_json adds 1 to the indent as write_json(std::any) does
+        std::any root = MJTomlSharedTable{std::shared_ptr<MJTomlTable const>(&table, [](MJTomlTable const *) {})};
+        MJTomlJsonPlan plan;
+        plan.buffers.emplace_back();
+        plan_json(&plan, root, indent - 1, is_strict, is_epoch);
+        
+        std::atomic<std::size_t> next_task(0);
+        auto run_tasks = [&] {
+            for (auto i = next_task++; i < plan.tasks.size(); i = next_task++) {
+                MJTomlStringBuffer buffer(&plan.buffers[plan.tasks[i].first]);
+                std::ostream os(&buffer);
+                plan.tasks[i].second(os);
+            }
+        };
+        std::vector<std::thread> workers;
+        auto worker_count = std::min<std::size_t>(std::max(jobs, 1) - 1, plan.tasks.size());
+        for (std::size_t i = 0; i < worker_count; ++i) {
+            workers.emplace_back(run_tasks);
+        }
+        run_tasks();
+        for (auto & worker : workers) {
+            worker.join();
+        }
+        
+        if (!write_all(fd, plan.buffers)) {
+            throw std::runtime_error(std::string("writev failed: ") + std::strerror(errno));
+        }
+        std::uint64_t bytes = 0;
+        for (auto const & buffer : plan.buffers) {
+            bytes += buffer.size();
+        }
+        return bytes;
+    }
+    
+    // MARK: -
+    
+    // Strings and keys are kept in the JSON escaped form, binary formats need the raw UTF-8.
+    static auto append_utf8(std::string * str, std::uint32_t code_point) -> void {
+        if (code_point < 0x80) {
+            str->push_back(static_cast<char>(code_point));
+        }
+        else if (code_point < 0x800) {
+            str->push_back(static_cast<char>(0xc0 | (code_point >> 6)));
+            str->push_back(static_cast<char>(0x80 | (code_point & 0x3f)));
+        }
+        else if (code_point < 0x10000) {
+            str->push_back(static_cast<char>(0xe0 | (code_point >> 12)));
+            str->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3f)));
+            str->push_back(static_cast<char>(0x80 | (code_point & 0x3f)));
+        }
+        else {
+            str->push_back(static_cast<char>(0xf0 | (code_point >> 18)));
+            str->push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3f)));
+            str->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3f)));
+            str->push_back(static_cast<char>(0x80 | (code_point & 0x3f)));
+        }
+    }
+    
+    static auto parse_hex(std::string const & str, std::size_t pos, std::size_t length, std::uint32_t * code_point) -> bool {
+        if (pos + length > str.size()) {
+            return false;
+        }
+        std::uint32_t result = 0;
+        for (auto i = pos; i < pos + length; ++i) {
+            auto c = str[i];
+            result <<= 4;
+            if (c >= '0' && c <= '9') {
+                result |= c - '0';
+            }
+            else if (c >= 'A' && c <= 'F') {
+                result |= c - 'A' + 10;
+            }
+            else if (c >= 'a' && c <= 'f') {
+                result |= c - 'a' + 10;
+            }
+            else {
+                return false;
+            }
+        }
+        *code_point = result;
+        return true;
+    }
+    
+    static auto unescape_string(std::string const & escaped) -> std::string {
+        std::string str;
+        str.reserve(escaped.size());
+        for (std::size_t i = 0; i < escaped.size(); ++i) {
+            if (escaped[i] != '\\' || i + 1 >= escaped.size()) {
+                str.push_back(escaped[i]);
+                continue;
+            }
+            auto c = escaped[++i];
+            switch (c) {
+                case 'b': str.push_back('\b'); break;
+                case 't': str.push_back('\t'); break;
+                case 'n': str.push_back('\n'); break;
+                case 'f': str.push_back('\f'); break;
+                case 'r': str.push_back('\r'); break;
+                case 'u':
+                case 'U': {
+                    std::uint32_t code_point;
+                    auto length = std::size_t(c == 'u' ? 4 : 8);
+                    if (!parse_hex(escaped, i + 1, length, &code_point)) {
+                        throw std::invalid_argument("ill-formed of unicode escape");
+                    }
+                    i += length;
+                    // Surrogate pair, e.g. \uD83D\uDE00
+                    std::uint32_t low;
+                    if (code_point >= 0xd800 && code_point < 0xdc00
+                        && i + 2 < escaped.size() && escaped[i + 1] == '\\' && escaped[i + 2] == 'u'
+                        && parse_hex(escaped, i + 3, 4, &low) && low >= 0xdc00 && low < 0xe000) {
+                        code_point = 0x10000 + ((code_point - 0xd800) << 10) + (low - 0xdc00);
+                        i += 6;
+                    }
+                    append_utf8(&str, code_point);
+                    break;
+                }
+                default:
+                    // \" \\ \/
+                    str.push_back(c);
+                    break;
+            }
+        }
+        return str;
+    }
+    
+    static auto write_be(std::ostream & os, std::uint64_t value, int size) -> void {
+        char buf[8];
+        for (int i = 0; i < size; ++i) {
+            buf[i] = static_cast<char>(value >> ((size - 1 - i) * 8));
+        }
+        os.write(buf, size);
+    }
+    
+    static auto write_byte(std::ostream & os, std::uint8_t byte) -> void {
+        os.put(static_cast<char>(byte));
+    }
+    
+    static auto double_bits(double value) -> std::uint64_t {
+        std::uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+    
+    // MARK: - MessagePack
+    
+    // Application specific extension type for TOML date-time, the payload is the RFC 3339 string.
+    static std::int8_t const MSGPACK_EXT_DATETIME = 1;
+    static std::int8_t const MSGPACK_EXT_TIMESTAMP = -1;
+    
+    static auto write_msgpack_length(std::ostream & os, std::size_t length, std::uint8_t fix, std::size_t fix_max, std::uint8_t type8, std::uint8_t type16, std::uint8_t type32) -> void {
+        if (length <= fix_max) {
+            write_byte(os, static_cast<std::uint8_t>(fix | length));
+        }
+        else if (type8 != 0 && length <= 0xff) {
+            write_byte(os, type8);
+            write_be(os, length, 1);
+        }
+        else if (length <= 0xffff) {
+            write_byte(os, type16);
+            write_be(os, length, 2);
+        }
+        else if (length <= 0xffffffff) {
+            write_byte(os, type32);
+            write_be(os, length, 4);
+        }
+        else {
+            throw std::length_error("too large for msgpack");
+        }
+    }
+    
+    static auto write_msgpack_string(std::ostream & os, std::string const & str) -> void {
+        write_msgpack_length(os, str.size(), 0xa0, 31, 0xd9, 0xda, 0xdb);
+        os.write(str.data(), str.size());
+    }
+    
+    static auto write_msgpack_integer(std::ostream & os, MJTomlInteger value) -> void {
+        if (value >= 0) {
+            auto u = static_cast<std::uint64_t>(value);
+            if (u <= 0x7f) {
+                write_byte(os, static_cast<std::uint8_t>(u));
+            }
+            else if (u <= 0xff) {
+                write_byte(os, 0xcc);
+                write_be(os, u, 1);
+            }
+            else if (u <= 0xffff) {
+                write_byte(os, 0xcd);
+                write_be(os, u, 2);
+            }
+            else if (u <= 0xffffffff) {
+                write_byte(os, 0xce);
+                write_be(os, u, 4);
+            }
+            else {
+                write_byte(os, 0xcf);
+                write_be(os, u, 8);
+            }
+        }
+        else {
+            auto u = static_cast<std::uint64_t>(value);
+            if (value >= -32) {
+                write_byte(os, static_cast<std::uint8_t>(u));
+            }
+            else if (value >= std::numeric_limits<std::int8_t>::min()) {
+                write_byte(os, 0xd0);
+                write_be(os, u, 1);
+            }
+            else if (value >= std::numeric_limits<std::int16_t>::min()) {
+                write_byte(os, 0xd1);
+                write_be(os, u, 2);
+            }
+            else if (value >= std::numeric_limits<std::int32_t>::min()) {
+                write_byte(os, 0xd2);
+                write_be(os, u, 4);
+            }
+            else {
+                write_byte(os, 0xd3);
+                write_be(os, u, 8);
+            }
+        }
+    }
+    
+    static auto write_msgpack_ext(std::ostream & os, std::int8_t type, std::string const & data) -> void {
+        auto length = data.size();
+        switch (length) {
+            case 1: write_byte(os, 0xd4); break;
+            case 2: write_byte(os, 0xd5); break;
+            case 4: write_byte(os, 0xd6); break;
+            case 8: write_byte(os, 0xd7); break;
+            case 16: write_byte(os, 0xd8); break;
+            default:
+                if (length <= 0xff) {
+                    write_byte(os, 0xc7);
+                    write_be(os, length, 1);
+                }
+                else if (length <= 0xffff) {
+                    write_byte(os, 0xc8);
+                    write_be(os, length, 2);
+                }
+                else if (length <= 0xffffffff) {
+                    write_byte(os, 0xc9);
+                    write_be(os, length, 4);
+                }
+                else {
+                    throw std::length_error("too large for msgpack");
+                }
+                break;
+        }
+        write_byte(os, static_cast<std::uint8_t>(type));
+        os.write(data.data(), length);
+    }
+    
+    static auto write_msgpack_timestamp(std::ostream & os, MJTomlDateTime const & datetime) -> void {
+        auto seconds = epoch_seconds(datetime);
+        std::ostringstream data;
+        if (seconds >= 0 && (seconds >> 34) == 0) {
+            if (datetime.nanosecond == 0 && (seconds >> 32) == 0) {
+                // timestamp 32
+                write_be(data, static_cast<std::uint64_t>(seconds), 4);
+            }
+            else {
+                // timestamp 64
+                write_be(data, (static_cast<std::uint64_t>(datetime.nanosecond) << 34) | static_cast<std::uint64_t>(seconds), 8);
+            }
+        }
+        else {
+            // timestamp 96
+            write_be(data, datetime.nanosecond, 4);
+            write_be(data, static_cast<std::uint64_t>(seconds), 8);
+        }
+        write_msgpack_ext(os, MSGPACK_EXT_TIMESTAMP, data.str());
+    }
+    
+    static auto write_msgpack(std::ostream & os, std::any const & value, bool is_epoch) -> void;
+    
+    static auto write_msgpack(std::ostream & os, MJTomlTable const & table, bool is_epoch) -> void {
+        write_msgpack_length(os, table.size(), 0x80, 15, 0, 0xde, 0xdf);
+        for (auto itr = table.begin(); itr != table.end(); ++itr) {
+            write_msgpack_string(os, unescape_string(itr->first));
+            write_msgpack(os, itr->second, is_epoch);
+        }
+    }
+    
+    static auto write_msgpack(std::ostream & os, MJTomlArray const & array, bool is_epoch) -> void {
+        write_msgpack_length(os, array.size(), 0x90, 15, 0, 0xdc, 0xdd);
+        for (auto itr = array.begin(); itr != array.end(); ++itr) {
+            write_msgpack(os, *itr, is_epoch);
+        }
+    }
+    
+    static auto write_msgpack(std::ostream & os, std::any const & value, bool is_epoch) -> void {
+        if (value.type() == typeid(MJTomlTable)) {
+            write_msgpack(os, *std::any_cast<MJTomlTable>(&value), is_epoch);
+        }
+        else if (value.type() == typeid(MJTomlSharedTable)) {
+            write_msgpack(os, *std::any_cast<MJTomlSharedTable>(&value)->table, is_epoch);
+        }
+        else if (value.type() == typeid(MJTomlArray)) {
+            write_msgpack(os, *std::any_cast<MJTomlArray>(&value), is_epoch);
+        }
+        else if (value.type() == typeid(MJTomlSharedArray)) {
+            write_msgpack(os, *std::any_cast<MJTomlSharedArray>(&value)->array, is_epoch);
+        }
+        else if (value.type() == typeid(MJTomlString)) {
+            write_msgpack_string(os, unescape_string(*std::any_cast<MJTomlString>(&value)));
+        }
+        else if (value.type() == typeid(MJTomlBoolean)) {
+            write_byte(os, *std::any_cast<MJTomlBoolean>(&value) ? 0xc3 : 0xc2);
+        }
+        else if (value.type() == typeid(MJTomlInteger)) {
+            write_msgpack_integer(os, *std::any_cast<MJTomlInteger>(&value));
+        }
+        else if (value.type() == typeid(MJTomlFloat)) {
+            write_byte(os, 0xcb);
+            write_be(os, double_bits(*std::any_cast<MJTomlFloat>(&value)), 8);
+        }
+        else if (value.type() == typeid(MJTomlDescribedFloat)) {
+            write_byte(os, 0xcb);
+            write_be(os, double_bits(std::any_cast<MJTomlDescribedFloat>(&value)->value), 8);
+        }
+        else if (value.type() == typeid(MJTomlDateTime)) {
+            auto dt_ptr = std::any_cast<MJTomlDateTime>(&value);
+            if (is_epoch && dt_ptr->kind == MJTomlDateTimeKind::offset_date_time) {
+                write_msgpack_timestamp(os, *dt_ptr);
+            }
+            else {
+                write_msgpack_ext(os, MSGPACK_EXT_DATETIME, dt_ptr->value);
+            }
+        }
+        else {
+            throw std::logic_error("unknown type");
+        }
+    }
+    
+    // MARK: - CBOR (RFC 7049)
+    
+    static std::uint8_t const CBOR_UNSIGNED_INTEGER = 0;
+    static std::uint8_t const CBOR_NEGATIVE_INTEGER = 1;
+    static std::uint8_t const CBOR_TEXT_STRING = 3;
+    static std::uint8_t const CBOR_ARRAY = 4;
+    static std::uint8_t const CBOR_MAP = 5;
+    static std::uint8_t const CBOR_TAG = 6;
+    
+    static std::uint64_t const CBOR_TAG_DATETIME_STRING = 0; // RFC 3339 date-time with offset
+    static std::uint64_t const CBOR_TAG_EPOCH_DATETIME = 1;
+    static std::uint64_t const CBOR_TAG_FULL_DATE_STRING = 1004; // RFC 8943 full-date
+    
+    static auto write_cbor_head(std::ostream & os, std::uint8_t major_type, std::uint64_t value) -> void {
+        auto type = static_cast<std::uint8_t>(major_type << 5);
+        if (value < 24) {
+            write_byte(os, static_cast<std::uint8_t>(type | value));
+        }
+        else if (value <= 0xff) {
+            write_byte(os, type | 24);
+            write_be(os, value, 1);
+        }
+        else if (value <= 0xffff) {
+            write_byte(os, type | 25);
+            write_be(os, value, 2);
+        }
+        else if (value <= 0xffffffff) {
+            write_byte(os, type | 26);
+            write_be(os, value, 4);
+        }
+        else {
+            write_byte(os, type | 27);
+            write_be(os, value, 8);
+        }
+    }
+    
+    static auto write_cbor_string(std::ostream & os, std::string const & str) -> void {
+        write_cbor_head(os, CBOR_TEXT_STRING, str.size());
+        os.write(str.data(), str.size());
+    }
+    
+    // TOML allows a space or a lowercase t and z, the tag 0 requires the uppercase T and Z (RFC 3339, RFC 4287 3.3)
+    static auto normalized_datetime_string(MJTomlDateTime const & datetime) -> std::string {
+        auto str = datetime.value;
+        if (str.size() > 10 && (str[10] == ' ' || str[10] == 't')) {
+            str[10] = 'T';
+        }
+        if (!str.empty() && str.back() == 'z') {
+            str.back() = 'Z';
+        }
+        return str;
+    }
+    
+    static auto write_cbor_double(std::ostream & os, double value) -> void {
+        write_byte(os, 0xfb);
+        write_be(os, double_bits(value), 8);
+    }
+    
+    static auto write_cbor(std::ostream & os, std::any const & value, bool is_epoch) -> void;
+    
+    static auto write_cbor(std::ostream & os, MJTomlTable const & table, bool is_epoch) -> void {
+        write_cbor_head(os, CBOR_MAP, table.size());
+        for (auto itr = table.begin(); itr != table.end(); ++itr) {
+            write_cbor_string(os, unescape_string(itr->first));
+            write_cbor(os, itr->second, is_epoch);
+        }
+    }
+    
+    static auto write_cbor(std::ostream & os, MJTomlArray const & array, bool is_epoch) -> void {
+        write_cbor_head(os, CBOR_ARRAY, array.size());
+        for (auto itr = array.begin(); itr != array.end(); ++itr) {
+            write_cbor(os, *itr, is_epoch);
+        }
+    }
+    
+    static auto write_cbor(std::ostream & os, std::any const & value, bool is_epoch) -> void {
+        if (value.type() == typeid(MJTomlTable)) {
+            write_cbor(os, *std::any_cast<MJTomlTable>(&value), is_epoch);
+        }
+        else if (value.type() == typeid(MJTomlSharedTable)) {
+            write_cbor(os, *std::any_cast<MJTomlSharedTable>(&value)->table, is_epoch);
+        }
+        else if (value.type() == typeid(MJTomlArray)) {
+            write_cbor(os, *std::any_cast<MJTomlArray>(&value), is_epoch);
+        }
+        else if (value.type() == typeid(MJTomlSharedArray)) {
+            write_cbor(os, *std::any_cast<MJTomlSharedArray>(&value)->array, is_epoch);
+        }
+        else if (value.type() == typeid(MJTomlString)) {
+            write_cbor_string(os, unescape_string(*std::any_cast<MJTomlString>(&value)));
+        }
+        else if (value.type() == typeid(MJTomlBoolean)) {
+            write_byte(os, *std::any_cast<MJTomlBoolean>(&value) ? 0xf5 : 0xf4);
+        }
+        else if (value.type() == typeid(MJTomlInteger)) {
+            auto integer = *std::any_cast<MJTomlInteger>(&value);
+            if (integer >= 0) {
+                write_cbor_head(os, CBOR_UNSIGNED_INTEGER, static_cast<std::uint64_t>(integer));
+            }
+            else {
+                write_cbor_head(os, CBOR_NEGATIVE_INTEGER, static_cast<std::uint64_t>(-(integer + 1)));
+            }
+        }
+        else if (value.type() == typeid(MJTomlFloat)) {
+            write_cbor_double(os, *std::any_cast<MJTomlFloat>(&value));
+        }
+        else if (value.type() == typeid(MJTomlDescribedFloat)) {
+            write_cbor_double(os, std::any_cast<MJTomlDescribedFloat>(&value)->value);
+        }
+        else if (value.type() == typeid(MJTomlDateTime)) {
+            auto dt_ptr = std::any_cast<MJTomlDateTime>(&value);
+            if (is_epoch && dt_ptr->kind == MJTomlDateTimeKind::offset_date_time) {
+                write_cbor_head(os, CBOR_TAG, CBOR_TAG_EPOCH_DATETIME);
+                auto seconds = epoch_seconds(*dt_ptr);
+                if (dt_ptr->nanosecond != 0) {
+                    write_cbor_double(os, seconds + dt_ptr->nanosecond / 1e9);
+                }
+                else if (seconds >= 0) {
+                    write_cbor_head(os, CBOR_UNSIGNED_INTEGER, static_cast<std::uint64_t>(seconds));
+                }
+                else {
+                    write_cbor_head(os, CBOR_NEGATIVE_INTEGER, static_cast<std::uint64_t>(-(seconds + 1)));
+                }
+                return;
+            }
+            switch (dt_ptr->kind) {
+                case MJTomlDateTimeKind::offset_date_time:
+                    write_cbor_head(os, CBOR_TAG, CBOR_TAG_DATETIME_STRING);
+                    write_cbor_string(os, normalized_datetime_string(*dt_ptr));
+                    return;
+                case MJTomlDateTimeKind::local_date:
+                    write_cbor_head(os, CBOR_TAG, CBOR_TAG_FULL_DATE_STRING);
+                    break;
+                default:
+                    // No registered tag for local date-time and local time
+                    break;
+            }
+            write_cbor_string(os, dt_ptr->value);
+        }
+        else {
+            throw std::logic_error("unknown type");
+        }
+    }
+}
+
+namespace MoonJelly {
+    
+MJToml parse_toml(std::string_view str) {
+    MJToml toml;
     ::read_table(&toml.table, str.cbegin(), str.cend(), true);
     // MJTomlArrayParsing => MJTomlArray
-    ::convert_types(&toml.table);
+    ::convert_types(&toml.table, nullptr);
+    return toml;
+}
+
+MJToml parse_toml(std::string_view str, MJTomlStats * stats) {
+    if (stats == nullptr) {
+        return parse_toml(str);
+    }
+    
+    auto allocations = stats->allocation_counter != nullptr ? stats->allocation_counter() : 0;
+    MJToml toml;
+    {
+        std::uint64_t parse_ns = 0;
+        auto lex_ns = stats->lex_ns;
+        MJTomlStopwatch stopwatch(&parse_ns);
+        ::parsing_stats = stats;
+        try {
+            ::read_table(&toml.table, str.cbegin(), str.cend(), true);
+        }
+        catch (...) {
+            ::parsing_stats = nullptr;
+            throw;
+        }
+        ::parsing_stats = nullptr;
+        stopwatch.stop();
+        stats->build_ns += parse_ns - (stats->lex_ns - lex_ns);
+    }
+    {
+        MJTomlStopwatch stopwatch(&stats->convert_ns);
+        ::convert_types(&toml.table, stats);
+    }
+    stats->bytes_read += str.size();
+    if (stats->allocation_counter != nullptr) {
+        stats->parse_allocations += stats->allocation_counter() - allocations;
+    }
+    return toml;
+}
+
+MJToml share_toml(MJToml toml) {
+    toml.table = ::share_table(std::move(toml.table));
     return toml;
 }
 
-std::string string_json(MJToml const & toml, int indent, bool is_strict) {
-    return ::string_json(toml.table, indent, is_strict);
+MJToml overlay_toml(MJToml const & base, MJToml const & overlay) {
+    MJToml toml;
+    toml.table = ::overlay_table(base.table, overlay.table);
+    return toml;
+}
+
+MJTomlInteger epoch_seconds(MJTomlDateTime const & datetime) {
+    auto days = ::days_from_civil(datetime.year, datetime.month, datetime.day);
+    return days * 86400 + datetime.hour * 3600 + datetime.minute * 60 + datetime.second - datetime.offset_minutes * 60;
+}
+
+void write_json(std::ostream & os, MJToml const & toml, int indent, bool is_strict, bool is_epoch, MJTomlStats * stats) {
+    ::measure_write(os, stats, [&](std::ostream & os) {
+        ::write_json(os, toml.table, indent, is_strict, is_epoch);
+    });
+}
+
+void write_json_mapped(int fd, MJToml const & toml, int indent, bool is_strict, bool is_epoch, MJTomlStats * stats) {
+    MJTomlStopwatch stopwatch(stats != nullptr ? &stats->write_ns : nullptr);
+    auto allocations = stats != nullptr && stats->allocation_counter != nullptr ? stats->allocation_counter() : 0;
+    std::size_t size;
+    {
+        MJTomlMapping mapping;
+        size = ::write_json_exact(toml.table, indent, is_strict, is_epoch, [&](std::size_t size) {
+            if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+                throw std::runtime_error(std::string("ftruncate failed: ") + std::strerror(errno));
+            }
+            return mapping.map(fd, size);
+        });
+    }
+    if (::lseek(fd, static_cast<off_t>(size), SEEK_SET) < 0) {
+        throw std::runtime_error(std::string("lseek failed: ") + std::strerror(errno));
+    }
+    if (stats != nullptr) {
+        stats->bytes_written += size;
+        if (stats->allocation_counter != nullptr) {
+            stats->write_allocations += stats->allocation_counter() - allocations;
+        }
+    }
+}
+
+void write_msgpack(std::ostream & os, MJToml const & toml, bool is_epoch, MJTomlStats * stats) {
+    ::measure_write(os, stats, [&](std::ostream & os) {
+        ::write_msgpack(os, toml.table, is_epoch);
+    });
+}
+
+void write_cbor(std::ostream & os, MJToml const & toml, bool is_epoch, MJTomlStats * stats) {
+    ::measure_write(os, stats, [&](std::ostream & os) {
+        ::write_cbor(os, toml.table, is_epoch);
+    });
+}
+
+void write_json_parallel(int fd, MJToml const & toml, int jobs, int indent, bool is_strict, bool is_epoch, MJTomlStats * stats) {
+    MJTomlStopwatch stopwatch(stats != nullptr ? &stats->write_ns : nullptr);
+    auto allocations = stats != nullptr && stats->allocation_counter != nullptr ? stats->allocation_counter() : 0;
+    auto bytes = ::write_json_parallel(fd, toml.table, jobs, indent, is_strict, is_epoch);
+    if (stats != nullptr) {
+        stats->bytes_written += bytes;
+        if (stats->allocation_counter != nullptr) {
+            stats->write_allocations += stats->allocation_counter() - allocations;
+        }
+    }
+}
+
+std::string string_json(MJToml const & toml, int indent, bool is_strict, bool is_epoch) {
+    std::string str;
+    ::write_json_exact(toml.table, indent, is_strict, is_epoch, [&](std::size_t size) {
+        str.resize(size);
+        return &str[0];
+    });
+    return str;
+}
+
+std::string string_msgpack(MJToml const & toml, bool is_epoch) {
+    std::ostringstream ss;
+    ::write_msgpack(ss, toml.table, is_epoch);
+    return ss.str();
+}
+
+std::string string_cbor(MJToml const & toml, bool is_epoch) {
+    std::ostringstream ss;
+    ::write_cbor(ss, toml.table, is_epoch);
+    return ss.str();
+}
+
+std::string string_json(MJTomlStats const & stats) {
+    std::ostringstream ss;
+    ss << "{\n";
+    ss << "  \"time_ns\": {\n";
+    ss << "    \"lex\": " << stats.lex_ns << ",\n";
+    ss << "    \"build\": " << stats.build_ns << ",\n";
+    ss << "    \"convert\": " << stats.convert_ns << ",\n";
+    ss << "    \"write\": " << stats.write_ns << ",\n";
+    ss << "    \"read\": " << stats.read_ns << ",\n";
+    ss << "    \"read_wait\": " << stats.read_wait_ns << "\n";
+    ss << "  },\n";
+    ss << "  \"counts\": {\n";
+    ss << "    \"tables\": " << stats.tables << ",\n";
+    ss << "    \"arrays\": " << stats.arrays << ",\n";
+    ss << "    \"strings\": " << stats.strings << ",\n";
+    ss << "    \"integers\": " << stats.integers << ",\n";
+    ss << "    \"floats\": " << stats.floats << ",\n";
+    ss << "    \"booleans\": " << stats.booleans << ",\n";
+    ss << "    \"datetimes\": " << stats.datetimes << "\n";
+    ss << "  },\n";
+    if (stats.allocation_counter != nullptr) {
+        ss << "  \"allocations\": {\n";
+        ss << "    \"parse\": " << stats.parse_allocations << ",\n";
+        ss << "    \"write\": " << stats.write_allocations << "\n";
+        ss << "  },\n";
+    }
+    ss << "  \"bytes_read\": " << stats.bytes_read << ",\n";
+    ss << "  \"bytes_written\": " << stats.bytes_written << "\n";
+    ss << "}";
+    return ss.str();
 }
 
 }
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <cfloat>
+#include <cstdint>
 
 #if __has_include(<any>)
 #include <any>
@@ -18,8 +19,10 @@ namespace std {
 }
 #endif
 
+#include <iosfwd>
 #include <string>
 #include <map>
+#include <memory>
 #include <vector>
 
 namespace MoonJelly {
@@ -37,15 +40,98 @@ namespace MoonJelly {
         MJTomlFloat value;
         std::string description; // This will keep the original string as possible, is compatible with JSON string
     };
+    enum class MJTomlDateTimeKind : std::uint8_t {
+        offset_date_time,
+        local_date_time,
+        local_date,
+        local_time,
+    };
     struct MJTomlDateTime {
-        std::string value;
+        std::string value; // This will keep the original string
+        MJTomlDateTimeKind kind;
+        std::uint8_t month; // 1-12
+        std::uint8_t day; // 1-31
+        std::uint8_t hour;
+        std::uint8_t minute;
+        std::uint8_t second; // 0-60, includes a leap second
+        std::int16_t offset_minutes; // Valid only for offset_date_time
+        std::int32_t year;
+        std::uint32_t nanosecond;
+    };
+    
+    // Immutable subtrees shared between documents, see share_toml() and overlay_toml()
+    struct MJTomlSharedTable {
+        std::shared_ptr<MJTomlTable const> table;
+    };
+    struct MJTomlSharedArray {
+        std::shared_ptr<MJTomlArray const> array;
     };
     
     struct MJToml {
         MJTomlTable table;
     };
     
+    // Filled by the functions which take a MJTomlStats pointer, nothing is measured when it is nullptr.
+    struct MJTomlStats {
+        // Nanoseconds of each phase, lex is matching keys, headers and values, build is the rest of parsing
+        std::uint64_t lex_ns = 0;
+        std::uint64_t build_ns = 0;
+        std::uint64_t convert_ns = 0;
+        std::uint64_t write_ns = 0;
+        // Filled by MJTomlPrefetchReader, read is the time spent reading the files on the background thread,
+        // read_wait is the time the consumer was blocked waiting for them
+        std::uint64_t read_ns = 0;
+        std::uint64_t read_wait_ns = 0;
+        
+        std::uint64_t tables = 0;
+        std::uint64_t arrays = 0;
+        std::uint64_t strings = 0;
+        std::uint64_t integers = 0;
+        std::uint64_t floats = 0;
+        std::uint64_t booleans = 0;
+        std::uint64_t datetimes = 0;
+        
+        // Counted only if the application provides the allocation counter, e.g. by replacing operator new
+        std::uint64_t (* allocation_counter)() = nullptr;
+        std::uint64_t parse_allocations = 0;
+        std::uint64_t write_allocations = 0;
+        
+        std::uint64_t bytes_read = 0;
+        std::uint64_t bytes_written = 0;
+    };
+    
     extern MJToml parse_toml(std::string_view str);
-    extern std::string string_json(MJToml const & toml, int indent = 0, bool is_strict = true);
+    extern MJToml parse_toml(std::string_view str, MJTomlStats * stats);
+    
+    // Freezes the tables and arrays below the root into shared subtrees, copying the result is cheap
+    extern MJToml share_toml(MJToml toml);
+    // Merges the overlay into the base, tables are merged recursively and the other values are replaced.
+    // The subtrees of the base which the overlay does not touch are shared, not copied, if the base is the result
+    // of share_toml() or overlay_toml(). Those of a plain base are copied. The result is always shared.
+    extern MJToml overlay_toml(MJToml const & base, MJToml const & overlay);
+    
+    // is_epoch: Offset date-time values are written as seconds since the Unix epoch, the others are kept as they are
+    extern std::string string_json(MJToml const & toml, int indent = 0, bool is_strict = true, bool is_epoch = false);
+    extern std::string string_msgpack(MJToml const & toml, bool is_epoch = false);
+    extern std::string string_cbor(MJToml const & toml, bool is_epoch = false);
+    
+    // Streaming writers, the string_* functions are built on them
+    extern void write_json(std::ostream & os, MJToml const & toml, int indent = 0, bool is_strict = true, bool is_epoch = false, MJTomlStats * stats = nullptr);
+    extern void write_msgpack(std::ostream & os, MJToml const & toml, bool is_epoch = false, MJTomlStats * stats = nullptr);
+    extern void write_cbor(std::ostream & os, MJToml const & toml, bool is_epoch = false, MJTomlStats * stats = nullptr);
+    
+    // Measures the exact size, resizes the file to it and fills the mapping, the file offset is moved to the end.
+    // fd must be a regular file opened for reading and writing. The output is identical to write_json.
+    extern void write_json_mapped(int fd, MJToml const & toml, int indent = 0, bool is_strict = true, bool is_epoch = false, MJTomlStats * stats = nullptr);
+    
+    // Writes large sibling subtrees into separate buffers on the jobs threads, then writes the buffers in order
+    // with writev. The output is identical to write_json.
+    extern void write_json_parallel(int fd, MJToml const & toml, int jobs, int indent = 0, bool is_strict = true, bool is_epoch = false, MJTomlStats * stats = nullptr);
+    
+    // JSON report of the stats
+    extern std::string string_json(MJTomlStats const & stats);
+    
+    // Seconds since the Unix epoch (1970-01-01T00:00:00Z), local values are regarded as UTC
+    extern MJTomlInteger epoch_seconds(MJTomlDateTime const & datetime);
     
 }
@@ -0,0 +1,276 @@
+//
+//  MJTomlConfig.cpp
+//  MoonJelly
+//
+//  Created by toml2json contributors on 2026/10/18.
+//
+
+#include "MJTomlConfig.hpp"
+
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if __has_include(<sys/inotify.h>)
+#include <sys/inotify.h>
+#define MJTOML_HAS_INOTIFY 1
+#endif
+
+namespace {
+    using namespace MoonJelly;
+    
+    static auto read_file(std::string const & path) -> std::string {
+        std::ifstream ifs(path);
+        if (ifs.fail()) {
+            throw std::runtime_error("File not found: " + path);
+        }
+        return std::string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    }
+    
+    struct MJTomlFileStamp {
+        bool exists;
+        dev_t device;
+        ino_t inode;
+        off_t size;
+        struct timespec modified;
+        
+        bool operator==(MJTomlFileStamp const & other) const {
+            return exists == other.exists && device == other.device && inode == other.inode && size == other.size
+                && modified.tv_sec == other.modified.tv_sec && modified.tv_nsec == other.modified.tv_nsec;
+        }
+        bool operator!=(MJTomlFileStamp const & other) const {
+            return !(*this == other);
+        }
+    };
+    
+    static auto file_stamp(std::string const & path) -> MJTomlFileStamp {
+        MJTomlFileStamp stamp = {};
+        struct stat st;
+        if (::stat(path.c_str(), &st) == 0) {
+            stamp.exists = true;
+            stamp.device = st.st_dev;
+            stamp.inode = st.st_ino;
+            stamp.size = st.st_size;
+#if defined(__APPLE__)
+            stamp.modified = st.st_mtimespec;
+#else
+            stamp.modified = st.st_mtim;
+#endif
+        }
+        return stamp;
+    }
+
+#ifdef MJTOML_HAS_INOTIFY
+    static auto split_path(std::string const & path) -> std::pair<std::string, std::string> {
+        auto pos = path.rfind('/');
+        if (pos == std::string::npos) {
+            return {".", path};
+        }
+        return {pos == 0 ? "/" : path.substr(0, pos), path.substr(pos + 1)};
+    }
+#endif
+}
+
+namespace MoonJelly {
+
+MJTomlConfigHandle::Snapshot::Snapshot(Snapshot && other) noexcept : slot_(other.slot_), node_(other.node_) {
+    other.slot_ = nullptr;
+    other.node_ = nullptr;
+}
+
+MJTomlConfigHandle::Snapshot::~Snapshot() {
+    if (slot_ != nullptr) {
+        slot_->store(0);
+    }
+}
+
+MJTomlConfigHandle::ReaderBlock::ReaderBlock() : next(nullptr) {
+    for (auto & slot : slots) {
+        slot.epoch.store(0);
+    }
+}
+
+MJTomlConfigHandle::MJTomlConfigHandle(std::string path, std::chrono::milliseconds poll_interval, ErrorHandler error_handler)
+    : path_(std::move(path)), poll_interval_(poll_interval), error_handler_(std::move(error_handler)),
+      current_(nullptr), epoch_(1), is_stopping_(false), wakeup_fds_{-1, -1} {
+    current_.store(new Node{parse_toml(read_file(path_)), 1});
+    
+    if (::pipe(wakeup_fds_) != 0) {
+        delete current_.load();
+        throw std::runtime_error("pipe failed");
+    }
+    ::fcntl(wakeup_fds_[0], F_SETFL, O_NONBLOCK);
+    watcher_ = std::thread(&MJTomlConfigHandle::watch, this);
+}
+
+MJTomlConfigHandle::~MJTomlConfigHandle() {
+    is_stopping_.store(true);
+    char c = 0;
+    __attribute__((unused))
+    auto result = ::write(wakeup_fds_[1], &c, 1);
+    watcher_.join();
+    ::close(wakeup_fds_[0]);
+    ::close(wakeup_fds_[1]);
+    
+    for (auto & retired : retired_) {
+        delete retired.second;
+    }
+    delete current_.load();
+    
+    auto block = reader_blocks_.next.load();
+    while (block != nullptr) {
+        auto next = block->next.load();
+        delete block;
+        block = next;
+    }
+}
+
+MJTomlConfigHandle::Snapshot MJTomlConfigHandle::read() const {
+    // Start from a per-thread slot to avoid contention, a slot is claimed by announcing the epoch
+    auto start = std::hash<std::thread::id>()(std::this_thread::get_id()) % READER_BLOCK_SIZE;
+    for (auto block = &reader_blocks_; ; ) {
+        for (std::size_t i = 0; i < READER_BLOCK_SIZE; ++i) {
+            auto & slot = block->slots[(start + i) % READER_BLOCK_SIZE].epoch;
+            std::uint64_t expected = 0;
+            if (slot.load() == 0 && slot.compare_exchange_strong(expected, epoch_.load())) {
+                // The node is loaded after the epoch is announced, so it is not reclaimed until the slot is released
+                return Snapshot(&slot, current_.load());
+            }
+        }
+        
+        auto next = block->next.load();
+        if (next == nullptr) {
+            // All slots are held, append a block instead of waiting for a release
+            auto new_block = new ReaderBlock();
+            if (block->next.compare_exchange_strong(next, new_block)) {
+                next = new_block;
+            }
+            else {
+                delete new_block;
+            }
+        }
+        block = next;
+    }
+}
+
+std::uint64_t MJTomlConfigHandle::version() const {
+    auto snapshot = read();
+    return snapshot.version();
+}
+
+auto MJTomlConfigHandle::watch() -> void {
+    auto stamp = file_stamp(path_);
+    // A changed stamp is reloaded when the next poll sees it again, the file may be being written
+    auto pending_stamp = stamp;
+    
+    int inotify_fd = -1;
+#ifdef MJTOML_HAS_INOTIFY
+    auto dir_and_name = split_path(path_);
+    inotify_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd >= 0) {
+        // Watch the directory, editors often replace the file by renaming.
+        // Only complete writes are watched, a created file may still be empty.
+        auto mask = IN_CLOSE_WRITE | IN_MOVED_TO;
+        if (::inotify_add_watch(inotify_fd, dir_and_name.first.c_str(), mask) < 0) {
+            ::close(inotify_fd);
+            inotify_fd = -1;
+        }
+    }
+#endif
+    
+    while (!is_stopping_.load()) {
+        struct pollfd fds[2] = {{wakeup_fds_[0], POLLIN, 0}, {inotify_fd, POLLIN, 0}};
+        // Also wakes up periodically to reclaim the snapshots released after the last reload
+        if (::poll(fds, inotify_fd >= 0 ? 2 : 1, static_cast<int>(poll_interval_.count())) < 0) {
+            continue;
+        }
+        if (is_stopping_.load()) {
+            break;
+        }
+        
+        auto is_changed = false;
+#ifdef MJTOML_HAS_INOTIFY
+        if (inotify_fd >= 0) {
+            alignas(struct inotify_event) char buf[4096];
+            ssize_t length;
+            while ((length = ::read(inotify_fd, buf, sizeof(buf))) > 0) {
+                for (auto ptr = buf; ptr < buf + length; ) {
+                    auto event = reinterpret_cast<struct inotify_event *>(ptr);
+                    if (event->len > 0 && dir_and_name.second == event->name) {
+                        is_changed = true;
+                    }
+                    ptr += sizeof(struct inotify_event) + event->len;
+                }
+            }
+        }
+        else
+#endif
+        {
+            auto new_stamp = file_stamp(path_);
+            if (new_stamp != stamp && new_stamp == pending_stamp) {
+                stamp = new_stamp;
+                is_changed = new_stamp.exists;
+            }
+            pending_stamp = new_stamp;
+        }
+        
+        if (is_changed) {
+            reload();
+        }
+        reclaim();
+    }
+    
+    if (inotify_fd >= 0) {
+        ::close(inotify_fd);
+    }
+}
+
+auto MJTomlConfigHandle::reload() -> void {
+    try {
+        auto version = current_.load()->version + 1;
+        publish(new Node{parse_toml(read_file(path_)), version});
+    }
+    catch (std::exception const & e) {
+        if (error_handler_) {
+            error_handler_(e.what());
+        }
+    }
+}
+
+auto MJTomlConfigHandle::publish(Node * node) -> void {
+    auto old_node = current_.exchange(node);
+    // Readers which observe this epoch or later never see the old node
+    auto retired_epoch = epoch_.fetch_add(1) + 1;
+    retired_.emplace_back(retired_epoch, old_node);
+}
+
+auto MJTomlConfigHandle::reclaim() -> void {
+    auto min_epoch = std::numeric_limits<std::uint64_t>::max();
+    for (auto block = &reader_blocks_; block != nullptr; block = block->next.load()) {
+        for (auto & slot : block->slots) {
+            auto epoch = slot.epoch.load();
+            if (epoch != 0 && epoch < min_epoch) {
+                min_epoch = epoch;
+            }
+        }
+    }
+    
+    auto itr = retired_.begin();
+    while (itr != retired_.end()) {
+        if (itr->first <= min_epoch) {
+            delete itr->second;
+            itr = retired_.erase(itr);
+        }
+        else {
+            ++itr;
+        }
+    }
+}
+
+}
@@ -0,0 +1,101 @@
+//
+//  MJTomlConfig.hpp
+//  MoonJelly
+//
+//  Created by toml2json contributors on 2026/10/18.
+//
+
+#pragma once
+
+#include "MJToml.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+
+namespace MoonJelly {
+    
+    // Watches a toml file and publishes each successfully parsed version as an immutable snapshot.
+    // Readers never take a lock: the current snapshot is swapped atomically, and the old ones are
+    // reclaimed after every reader which might see them has released its snapshot (epoch-based).
+    // Each live snapshot holds a reader slot, more slots are appended when all of them are held.
+    class MJTomlConfigHandle {
+    public:
+        static std::size_t const READER_BLOCK_SIZE = 64;
+        
+        struct Node {
+            MJToml toml;
+            std::uint64_t version;
+        };
+        
+        // Pins the snapshot while it is alive, must not outlive the handle.
+        class Snapshot {
+        public:
+            Snapshot(Snapshot && other) noexcept;
+            Snapshot(Snapshot const &) = delete;
+            Snapshot & operator=(Snapshot const &) = delete;
+            Snapshot & operator=(Snapshot &&) = delete;
+            ~Snapshot();
+            
+            MJToml const & toml() const { return node_->toml; }
+            MJToml const & operator*() const { return node_->toml; }
+            MJToml const * operator->() const { return &node_->toml; }
+            std::uint64_t version() const { return node_->version; }
+        
+        private:
+            friend class MJTomlConfigHandle;
+            Snapshot(std::atomic<std::uint64_t> * slot, Node const * node) : slot_(slot), node_(node) {}
+            
+            std::atomic<std::uint64_t> * slot_;
+            Node const * node_;
+        };
+        
+        using ErrorHandler = std::function<void(std::string const & message)>;
+        
+        // Parses the file synchronously, throws if the initial version is not available.
+        // The error handler is called on the watcher thread when a reload fails, the current snapshot is kept.
+        explicit MJTomlConfigHandle(std::string path, std::chrono::milliseconds poll_interval = std::chrono::milliseconds(1000), ErrorHandler error_handler = nullptr);
+        MJTomlConfigHandle(MJTomlConfigHandle const &) = delete;
+        MJTomlConfigHandle & operator=(MJTomlConfigHandle const &) = delete;
+        ~MJTomlConfigHandle();
+        
+        Snapshot read() const;
+        std::uint64_t version() const;
+    
+    private:
+        // One slot per cache line, so that readers on different threads do not bounce a shared line
+        struct alignas(64) ReaderSlot {
+            // 0: unused, otherwise the epoch observed by the reader
+            std::atomic<std::uint64_t> epoch;
+        };
+        
+        struct ReaderBlock {
+            ReaderBlock();
+            std::array<ReaderSlot, READER_BLOCK_SIZE> slots;
+            // Appended once and kept until the handle is destroyed, the snapshots point into the blocks
+            std::atomic<ReaderBlock *> next;
+        };
+        
+        auto watch() -> void;
+        auto reload() -> void;
+        auto publish(Node * node) -> void;
+        auto reclaim() -> void;
+        
+        std::string path_;
+        std::chrono::milliseconds poll_interval_;
+        ErrorHandler error_handler_;
+        
+        std::atomic<Node *> current_;
+        std::atomic<std::uint64_t> epoch_;
+        mutable ReaderBlock reader_blocks_;
+        // Touched by the watcher thread only
+        std::vector<std::pair<std::uint64_t, Node *>> retired_;
+        
+        std::atomic<bool> is_stopping_;
+        int wakeup_fds_[2];
+        std::thread watcher_;
+    };
+
+}
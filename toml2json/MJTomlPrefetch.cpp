@@ -0,0 +1,121 @@
+//
+//  MJTomlPrefetch.cpp
+//  MoonJelly
+//
+//  Created by toml2json contributors on 2026/10/18.
+//
+
+#include "MJTomlPrefetch.hpp"
+
+#include <cerrno>
+#include <chrono>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    using namespace MoonJelly;
+    
+    static auto elapsed_ns(std::chrono::steady_clock::time_point begin) -> std::uint64_t {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+    }
+    
+    // Reads the whole file with the size from fstat, falls back to growing the string for pipes and the like
+    static auto read_file(std::string const & path, std::string & str) -> bool {
+        auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        std::size_t size = 0;
+        if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+            // One more byte to see the end of the file without growing
+            str.resize(static_cast<std::size_t>(st.st_size) + 1);
+        }
+        for (;;) {
+            if (size == str.size()) {
+                str.resize(size < 4096 ? 4096 : size * 2);
+            }
+            auto length = ::read(fd, &str[size], str.size() - size);
+            if (length < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                ::close(fd);
+                return false;
+            }
+            if (length == 0) {
+                break;
+            }
+            size += static_cast<std::size_t>(length);
+        }
+        str.resize(size);
+        ::close(fd);
+        return true;
+    }
+}
+
+namespace MoonJelly {
+
+MJTomlPrefetchReader::MJTomlPrefetchReader(std::vector<std::string> paths, std::size_t depth, MJTomlStats * stats)
+    : paths_(std::move(paths)), depth_(depth < 1 ? 1 : depth), stats_(stats), consumed_(0), is_stopping_(false) {
+    reader_ = std::thread(&MJTomlPrefetchReader::run, this);
+}
+
+MJTomlPrefetchReader::~MJTomlPrefetchReader() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        is_stopping_ = true;
+    }
+    cond_.notify_all();
+    reader_.join();
+}
+
+bool MJTomlPrefetchReader::next(Input & input) {
+    if (consumed_ == paths_.size()) {
+        return false;
+    }
+    auto begin = std::chrono::steady_clock::now();
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this] { return !queue_.empty(); });
+        input = std::move(queue_.front());
+        queue_.pop_front();
+    }
+    // The reader may be waiting for a free slot
+    cond_.notify_all();
+    ++consumed_;
+    
+    if (stats_ != nullptr) {
+        stats_->read_wait_ns += elapsed_ns(begin);
+        stats_->read_ns += input.read_ns;
+    }
+    return true;
+}
+
+auto MJTomlPrefetchReader::run() -> void {
+    for (auto const & path : paths_) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [this] { return is_stopping_ || queue_.size() < depth_; });
+            if (is_stopping_) {
+                return;
+            }
+        }
+        
+        Input input;
+        input.path = path;
+        auto begin = std::chrono::steady_clock::now();
+        input.is_found = ::read_file(path, input.str);
+        input.read_ns = ::elapsed_ns(begin);
+        
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(std::move(input));
+        }
+        cond_.notify_all();
+    }
+}
+
+}
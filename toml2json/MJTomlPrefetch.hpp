@@ -0,0 +1,54 @@
+//
+//  MJTomlPrefetch.hpp
+//  MoonJelly
+//
+//  Created by toml2json contributors on 2026/10/18.
+//
+
+#pragma once
+
+#include "MJToml.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace MoonJelly {
+    
+    // Reads the files in order on a background thread, at most depth files ahead of the consumer,
+    // so that reading the next files overlaps with parsing and writing the current one.
+    class MJTomlPrefetchReader {
+    public:
+        struct Input {
+            std::string path;
+            std::string str;
+            bool is_found = false;
+            std::uint64_t read_ns = 0;
+        };
+        
+        // stats: read_ns and read_wait_ns are added by next(), on the consumer thread
+        explicit MJTomlPrefetchReader(std::vector<std::string> paths, std::size_t depth = 2, MJTomlStats * stats = nullptr);
+        MJTomlPrefetchReader(MJTomlPrefetchReader const &) = delete;
+        MJTomlPrefetchReader & operator=(MJTomlPrefetchReader const &) = delete;
+        ~MJTomlPrefetchReader();
+        
+        // Blocks until the next file is read, returns false after the last one
+        bool next(Input & input);
+    
+    private:
+        auto run() -> void;
+        
+        std::vector<std::string> paths_;
+        std::size_t depth_;
+        MJTomlStats * stats_;
+        std::size_t consumed_;
+        
+        std::mutex mutex_;
+        std::condition_variable cond_;
+        std::deque<Input> queue_;
+        bool is_stopping_;
+        std::thread reader_;
+    };
+
+}
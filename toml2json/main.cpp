@@ -7,27 +7,196 @@
 
 #include <iostream>
 #include <fstream>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "MJToml.hpp"
+#include "MJTomlPrefetch.hpp"
+
+// Counts the allocations for --stats only, the shared counter would be contended by the --jobs workers.
+// The flag is set while parsing the arguments, before any thread is started.
+static bool is_counting_allocations = false;
+static std::atomic<std::uint64_t> allocation_count(0);
+
+void * operator new(std::size_t size) {
+    if (is_counting_allocations) {
+        allocation_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (auto ptr = std::malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void * ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void * ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+static std::uint64_t count_allocations() {
+    return allocation_count.load(std::memory_order_relaxed);
+}
+
+static void usage() {
+    std::cout << "Usage: toml2json [--format json|msgpack|cbor] [--epoch] [--stats] [--jobs N] [--prefetch N] [--output FILE] tomlfile..." << std::endl;
+}
+
+// Returns the exit status
+static int write_output(MoonJelly::MJToml const & toml, std::string const & format, bool is_epoch, int jobs, const char * output_path, MoonJelly::MJTomlStats * stats_ptr) {
+    if (output_path != nullptr) {
+        // JSON is written in place through the mapping, the others are streamed into the file
+        if (format != "json") {
+            std::ofstream ofs(output_path, std::ios::binary);
+            if (format == "msgpack") {
+                MoonJelly::write_msgpack(ofs, toml, is_epoch, stats_ptr);
+            }
+            else {
+                MoonJelly::write_cbor(ofs, toml, is_epoch, stats_ptr);
+            }
+            if (!ofs) {
+                std::cerr << "Error: Cannot write the output file" << std::endl;
+                return 2;
+            }
+        }
+        else {
+            auto fd = ::open(output_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) {
+                std::cerr << "Error: Cannot open the output file" << std::endl;
+                return 2;
+            }
+            struct stat st;
+            if (jobs == 1 && (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))) {
+                // Devices and pipes such as /dev/null cannot be mapped, stream into them instead
+                ::close(fd);
+                std::ofstream ofs(output_path, std::ios::binary);
+                MoonJelly::write_json(ofs, toml, 0, true, is_epoch, stats_ptr);
+                ofs << std::endl;
+                if (!ofs) {
+                    std::cerr << "Error: Cannot write the output file" << std::endl;
+                    return 2;
+                }
+                return 0;
+            }
+            auto is_written = false;
+            try {
+                if (jobs > 1) {
+                    MoonJelly::write_json_parallel(fd, toml, jobs, 0, true, is_epoch, stats_ptr);
+                }
+                else {
+                    MoonJelly::write_json_mapped(fd, toml, 0, true, is_epoch, stats_ptr);
+                }
+                is_written = ::write(fd, "\n", 1) == 1;
+            }
+            catch (std::exception const &) {
+            }
+            if (::close(fd) != 0 || !is_written) {
+                std::cerr << "Error: Cannot write the output file" << std::endl;
+                return 2;
+            }
+        }
+    }
+    else if (format == "msgpack") {
+        MoonJelly::write_msgpack(std::cout, toml, is_epoch, stats_ptr);
+        std::cout.flush();
+    }
+    else if (format == "cbor") {
+        MoonJelly::write_cbor(std::cout, toml, is_epoch, stats_ptr);
+        std::cout.flush();
+    }
+    else if (jobs > 1) {
+        std::cout.flush();
+        MoonJelly::write_json_parallel(STDOUT_FILENO, toml, jobs, 0, true, is_epoch, stats_ptr);
+        std::cout << std::endl;
+    }
+    else {
+        MoonJelly::write_json(std::cout, toml, 0, true, is_epoch, stats_ptr);
+        std::cout << std::endl;
+    }
+    return 0;
+}
 
 int main(int argc, const char * argv[]) {
-    if (argc < 2) {
-        std::cout << "Usage: toml2json tomlfile" << std::endl;
+    std::string format = "json";
+    bool is_epoch = false;
+    bool is_stats = false;
+    int jobs = 1;
+    int prefetch = 2;
+    std::vector<std::string> paths;
+    const char * output_path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (::strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            format = argv[++i];
+        }
+        else if (::strncmp(argv[i], "--format=", 9) == 0) {
+            format = argv[i] + 9;
+        }
+        else if (::strcmp(argv[i], "--epoch") == 0) {
+            is_epoch = true;
+        }
+        else if (::strcmp(argv[i], "--stats") == 0) {
+            is_stats = true;
+            is_counting_allocations = true;
+        }
+        else if (::strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobs = std::atoi(argv[++i]);
+        }
+        else if (::strcmp(argv[i], "--prefetch") == 0 && i + 1 < argc) {
+            prefetch = std::atoi(argv[++i]);
+        }
+        else if (::strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output_path = argv[++i];
+        }
+        else if (argv[i][0] == '-') {
+            // An unknown option, or an option without its value
+            usage();
+            return 1;
+        }
+        else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.empty() || (format != "json" && format != "msgpack" && format != "cbor") || jobs < 1 || prefetch < 1
+        || (output_path != nullptr && paths.size() > 1)) {
+        usage();
         return 1;
     }
     
-    std::string str;
-    {
-        std::ifstream ifs(argv[1]);
-        if (ifs.fail()) {
-            std::cerr << "Error: File not found" << std::endl;
-            return 2;
+    MoonJelly::MJTomlStats stats;
+    stats.allocation_counter = count_allocations;
+    auto stats_ptr = is_stats ? &stats : nullptr;
+    
+    // The next files are read while the current one is parsed and written
+    int status = 0;
+    MoonJelly::MJTomlPrefetchReader reader(paths, static_cast<std::size_t>(prefetch), stats_ptr);
+    MoonJelly::MJTomlPrefetchReader::Input input;
+    while (reader.next(input)) {
+        if (!input.is_found) {
+            std::cerr << "Error: File not found";
+            if (paths.size() > 1) {
+                std::cerr << ": " << input.path;
+            }
+            std::cerr << std::endl;
+            status = 2;
+            continue;
+        }
+        auto toml = MoonJelly::parse_toml(input.str, stats_ptr);
+        auto result = write_output(toml, format, is_epoch, jobs, output_path, stats_ptr);
+        if (result != 0) {
+            status = result;
         }
-        
-        str = std::string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
     }
     
-    auto toml = MoonJelly::parse_toml(str);
-    std::cout << MoonJelly::string_json(toml) << std::endl;
-    return 0;
+    if (is_stats) {
+        std::cerr << MoonJelly::string_json(stats) << std::endl;
+    }
+    return status;
 }